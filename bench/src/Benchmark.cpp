@@ -0,0 +1,327 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "Benchmark.h"
+
+#include <OpenSpaceNet.h>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/make_unique.hpp>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sys/resource.h>
+#include <utility/Logging.h>
+
+namespace dg { namespace osn {
+
+using boost::filesystem::path;
+using boost::make_unique;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::move;
+using std::string;
+using std::vector;
+
+// Center of the mock map service area of interest
+static const double SERVICE_LON = -105.0;
+static const double SERVICE_LAT = 40.0;
+
+// Tile size of the mock map service
+static const int SERVICE_TILE_SIZE = 256;
+
+// Longitude of the west edge of a web mercator tile column
+static double tileLon(int x, int zoom)
+{
+    return x / std::pow(2.0, zoom) * 360.0 - 180.0;
+}
+
+// Latitude of the north edge of a web mercator tile row
+static double tileLat(int y, int zoom)
+{
+    return std::atan(std::sinh(M_PI * (1 - 2 * y / std::pow(2.0, zoom)))) * 180.0 / M_PI;
+}
+
+// Returns the file extension of an output format, or nullptr if it is not a file format
+static const char* outputExtension(const string& format)
+{
+    if(format == "shp") {
+        return ".shp";
+    } else if(format == "geojson") {
+        return ".geojson";
+    } else if(format == "kml") {
+        return ".kml";
+    } else if(format == "csv") {
+        return ".csv";
+    }
+
+    return nullptr;
+}
+
+// Returns the largest resident set size of this process so far, in bytes
+static int64_t peakMemory()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (int64_t) usage.ru_maxrss * 1024;
+}
+
+Benchmark::Benchmark(BenchmarkArgs&& args) :
+    args_(move(args))
+{
+}
+
+void Benchmark::run()
+{
+    prepareFiles();
+    if(args_.mapService) {
+        startServer();
+    }
+
+    vector<RunResult> results;
+    try {
+        for(int i = 0; i < args_.runs; ++i) {
+            OSN_LOG(info) << "Benchmark run " << i + 1 << " of " << args_.runs << "...";
+            results.push_back(runOnce());
+            OSN_LOG(info) << "Processed " << results.back().windows << " windows in "
+                          << results.back().processingSeconds << " s";
+        }
+    } catch(...) {
+        if(!args_.keepFiles) {
+            removeFiles();
+        }
+        throw;
+    }
+
+    if(!args_.keepFiles) {
+        removeFiles();
+    }
+
+    Json::Value root;
+    if(args_.mapService) {
+        auto& service = root["map_service"];
+        service["zoom"] = args_.zoom;
+        service["tiles"] = args_.tiles * args_.tiles;
+        service["max_connections"] = args_.maxConnections;
+        service["adaptive_connections"] = args_.adaptiveConnections;
+        service["latency_ms"] = args_.server.latencyMs;
+        service["jitter_ms"] = args_.server.jitterMs;
+        service["error_rate"] = args_.server.errorRate;
+        service["throttle_rate"] = args_.server.throttleRate;
+        service["max_concurrent"] = args_.server.maxConcurrent;
+
+        // Totals over all runs
+        root["server"] = server_->stats();
+        server_.reset();
+    } else {
+        auto& image = root["image"];
+        image["width"] = args_.image.size.width;
+        image["height"] = args_.image.size.height;
+        image["bands"] = args_.image.bands;
+        image["block_size"] = args_.image.blockSize;
+        image["compression"] = args_.image.compression;
+        image["include_fraction"] = args_.includeFraction;
+    }
+
+    root["runs"] = Json::Value(Json::arrayValue);
+    for(const auto& result : results) {
+        root["runs"].append(toJson(result));
+    }
+
+    // The median run is less affected by the page cache and other processes than the mean
+    std::sort(results.begin(), results.end(), [](const RunResult& a, const RunResult& b) {
+        return a.processingSeconds < b.processingSeconds;
+    });
+    root["median"] = toJson(results[results.size() / 2]);
+
+    // The peak of the process can not be told apart per run, it covers all runs and the image generation
+    root["peak_rss_bytes"] = (Json::Int64) peakMemory();
+
+    writeResults(root);
+}
+
+void Benchmark::prepareFiles()
+{
+    if(args_.workDir.empty()) {
+        args_.workDir = (boost::filesystem::temp_directory_path() /
+                         boost::filesystem::unique_path("osn-bench-%%%%-%%%%")).string();
+    }
+    createdWorkDir_ = boost::filesystem::create_directories(args_.workDir);
+
+    auto extension = outputExtension(args_.outputFormat);
+    DG_CHECK(extension, "Output format %s is not supported by the benchmark", args_.outputFormat.c_str());
+    outputPath_ = (path(args_.workDir) / (string("features") + extension)).string();
+
+    if(args_.mapService) {
+        auto tilePixels = (double) SERVICE_TILE_SIZE * SERVICE_TILE_SIZE;
+        imageMegabytes_ = args_.tiles * args_.tiles * tilePixels * 3 / (1024.0 * 1024.0);
+        return;
+    }
+
+    imagePath_ = (path(args_.workDir) / "image.tif").string();
+    OSN_LOG(info) << "Generating a " << args_.image.size.width << "x" << args_.image.size.height << " image with "
+                  << args_.image.bands << " bands...";
+    auto startTime = steady_clock::now();
+    SyntheticImage::create(imagePath_, args_.image);
+    duration<double> createTime = steady_clock::now() - startTime;
+    OSN_LOG(info) << "Image generated in " << createTime.count() << " s";
+
+    // Only the included part of the image is read
+    auto fraction = args_.includeFraction > 0 ? args_.includeFraction : 1.0;
+    imageMegabytes_ = fraction * args_.image.size.area() * args_.image.bands / (1024.0 * 1024.0);
+
+    if(args_.includeFraction > 0) {
+        regionPath_ = (path(args_.workDir) / "include.geojson").string();
+        SyntheticImage::createIncludeRegion(regionPath_, args_.image, args_.includeFraction);
+    }
+}
+
+void Benchmark::removeFiles() const
+{
+    // A work directory given by the user may hold other files, only the ones written here are removed
+    if(createdWorkDir_) {
+        boost::filesystem::remove_all(args_.workDir);
+        return;
+    }
+
+    if(!imagePath_.empty()) {
+        boost::filesystem::remove(imagePath_);
+    }
+    if(!regionPath_.empty()) {
+        boost::filesystem::remove(regionPath_);
+    }
+
+    // A shapefile comes with files of other extensions next to it
+    auto outputStem = path(outputPath_).stem();
+    for(const auto& entry : boost::filesystem::directory_iterator(args_.workDir)) {
+        if(entry.path().stem() == outputStem) {
+            boost::filesystem::remove(entry.path());
+        }
+    }
+}
+
+void Benchmark::startServer()
+{
+    server_ = make_unique<MockTileServer>(args_.server);
+
+    // The area of interest is a square of whole tiles, shrunk by a fraction of a pixel so that no
+    // neighboring tiles are downloaded
+    auto scale = std::pow(2.0, args_.zoom);
+    auto latRadians = SERVICE_LAT * M_PI / 180.0;
+    auto x = (int) ((SERVICE_LON + 180.0) / 360.0 * scale) - args_.tiles / 2;
+    auto mercatorY = std::log(std::tan(latRadians) + 1 / std::cos(latRadians)) / M_PI;
+    auto y = (int) ((1 - mercatorY) / 2 * scale) - args_.tiles / 2;
+
+    auto west = tileLon(x, args_.zoom);
+    auto east = tileLon(x + args_.tiles, args_.zoom);
+    auto north = tileLat(y, args_.zoom);
+    auto south = tileLat(y + args_.tiles, args_.zoom);
+    auto inset = (east - west) / (args_.tiles * SERVICE_TILE_SIZE * 10.0);
+    bbox_ = cv::Rect2d(cv::Point2d(west + inset, south + inset), cv::Point2d(east - inset, north - inset));
+}
+
+Benchmark::RunResult Benchmark::runOnce()
+{
+    OpenSpaceNetArgs args;
+    args.action = Action::DETECT;
+    if(args_.mapService) {
+        args.source = Source::TILE_JSON;
+        args.url = server_->url();
+        args.bbox = make_unique<cv::Rect2d>(bbox_);
+        args.zoom = args_.zoom;
+        args.maxConnections = args_.maxConnections;
+        args.adaptiveConnections = args_.adaptiveConnections;
+    } else {
+        args.source = Source::LOCAL;
+        args.image = imagePath_;
+    }
+    args.outputFormat = args_.outputFormat;
+    args.outputPath = outputPath_;
+    args.layerName = args_.outputFormat == "shp" ? path(outputPath_).stem().string() : "osndetects";
+    args.useCpu = args_.useCpu;
+    args.windowSize = args_.windowSize;
+    args.windowStep = args_.windowStep;
+    args.batchSize = args_.batchSize;
+    args.inferenceWorkers = args_.inferenceWorkers;
+    args.confidence = args_.confidence;
+    args.nms = args_.nms;
+    args.overlap = args_.overlap;
+    args.quiet = true;
+    if(!regionPath_.empty()) {
+        args.filterDefinition.push_back(std::make_pair(string("include"), vector<string> { regionPath_ }));
+    }
+    args.modelPaths = args_.modelPaths;
+
+    // The processing time starts with the first windows, so that it does not include loading the models.
+    // The progress values are totals over all passes, also with several inference workers or strips.
+    RunResult result;
+    std::mutex mutex;
+    bool started = false;
+    steady_clock::time_point processingStart;
+
+    OpenSpaceNet osn(move(args));
+    osn.setProgressCallback([&](const string& name, int64_t value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!started) {
+            started = true;
+            processingStart = steady_clock::now();
+        }
+
+        if(name == "processed") {
+            result.windows = value;
+        } else if(name == "features") {
+            result.features = value;
+        }
+    });
+
+    auto startTime = steady_clock::now();
+    osn.process();
+    auto endTime = steady_clock::now();
+
+    result.seconds = duration<double>(endTime - startTime).count();
+    result.processingSeconds = started ? duration<double>(endTime - processingStart).count() : result.seconds;
+    return result;
+}
+
+Json::Value Benchmark::toJson(const RunResult& result) const
+{
+    Json::Value value;
+    value["seconds"] = result.seconds;
+    value["processing_seconds"] = result.processingSeconds;
+    value["windows"] = (Json::Int64) result.windows;
+    value["features"] = (Json::Int64) result.features;
+    value["windows_per_second"] = result.processingSeconds > 0 ? result.windows / result.processingSeconds : 0.0;
+    value["megabytes_per_second"] = result.processingSeconds > 0 ? imageMegabytes_ / result.processingSeconds : 0.0;
+    return value;
+}
+
+void Benchmark::writeResults(const Json::Value& results) const
+{
+    Json::StreamWriterBuilder builder;
+    auto content = Json::writeString(builder, results) + "\n";
+    if(args_.resultsPath.empty()) {
+        std::cout << content;
+        return;
+    }
+
+    std::ofstream file(args_.resultsPath);
+    file << content;
+    DG_CHECK(file, "Unable to write %s", args_.resultsPath.c_str());
+}
+
+} } // namespace dg { namespace osn {
@@ -0,0 +1,102 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef OPENSPACENET_BENCHMARK_H
+#define OPENSPACENET_BENCHMARK_H
+
+#include "MockTileServer.h"
+#include "SyntheticImage.h"
+#include <cstdint>
+#include <json/json.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dg { namespace osn {
+
+struct BenchmarkArgs
+{
+    SyntheticImageSpec image;
+
+    // Processing options, passed on to OpenSpaceNet
+    std::vector<std::string> modelPaths;
+    bool useCpu = true;
+    std::vector<int> windowSize;
+    std::vector<int> windowStep;
+    int batchSize = 0;
+    int inferenceWorkers = 1;
+    float confidence = 95;
+    bool nms = false;
+    float overlap = 30;
+    std::string outputFormat = "geojson";
+
+    // Fraction of the image covered by an include region, 0 to process the whole image
+    double includeFraction = 0;
+
+    // If set, the tiles are downloaded from a local mock server through the tile-json service, instead of
+    // reading a generated image
+    bool mapService = false;
+    int zoom = 18;
+    int tiles = 32;
+    int maxConnections = 10;
+    bool adaptiveConnections = false;
+    MockTileServerOptions server;
+
+    int runs = 3;
+    std::string workDir;
+    bool keepFiles = false;
+    std::string resultsPath;
+};
+
+//
+// Runs the OpenSpaceNet pipeline on a generated image, or on the tiles of a mock map service, a
+// number of times and reports its throughput and memory use as JSON
+//
+class Benchmark
+{
+public:
+    explicit Benchmark(BenchmarkArgs&& args);
+    void run();
+
+private:
+    struct RunResult
+    {
+        double seconds = 0;
+        double processingSeconds = 0;
+        int64_t windows = 0;
+        int64_t features = 0;
+    };
+
+    void prepareFiles();
+    void removeFiles() const;
+    void startServer();
+    RunResult runOnce();
+    Json::Value toJson(const RunResult& result) const;
+    void writeResults(const Json::Value& results) const;
+
+    BenchmarkArgs args_;
+    std::string imagePath_;
+    std::string regionPath_;
+    std::string outputPath_;
+    bool createdWorkDir_ = false;
+    double imageMegabytes_ = 0;
+    std::unique_ptr<MockTileServer> server_;
+    cv::Rect2d bbox_;
+};
+
+} } // namespace dg { namespace osn {
+
+#endif //OPENSPACENET_BENCHMARK_H
@@ -0,0 +1,518 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "MockTileServer.h"
+
+#include <arpa/inet.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <netinet/in.h>
+#include <OpenSpaceNetArgs.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility/Logging.h>
+
+namespace dg { namespace osn {
+
+using boost::format;
+using boost::lexical_cast;
+using boost::to_lower_copy;
+using boost::to_upper_copy;
+using std::chrono::duration;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::map;
+using std::move;
+using std::mutex;
+using std::string;
+using std::thread;
+using std::vector;
+
+static const int TILE_SIZE = 256;
+
+// Number of distinct tiles, which are encoded once and served in a pattern that covers the grid
+static const int TILE_VARIANTS = 16;
+
+// Side of the uniform fields the tile texture is made of, in pixels
+static const int FIELD_SIZE = 32;
+
+// Zoom levels listed in the WMTS capabilities
+static const int MAX_ZOOM = 22;
+
+// Web mercator extent and the scale denominator of zoom level 0
+static const double MERCATOR_EXTENT = 20037508.3427892;
+static const double SCALE_DENOMINATOR = 559082264.0287178;
+
+static const char* statusText(int status)
+{
+    switch(status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
+
+static bool sendAll(int fd, const string& data)
+{
+    size_t sent = 0;
+    while(sent < data.size()) {
+        auto ret = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(ret <= 0) {
+            return false;
+        }
+        sent += ret;
+    }
+
+    return true;
+}
+
+// Returns the parameters of a query string, with upper case names
+static map<string, string> parseQuery(const string& query)
+{
+    map<string, string> params;
+    vector<string> pairs;
+    boost::split(pairs, query, boost::is_any_of("&"));
+    for(const auto& pair : pairs) {
+        auto separator = pair.find('=');
+        if(separator != string::npos) {
+            params[to_upper_copy(pair.substr(0, separator))] = pair.substr(separator + 1);
+        }
+    }
+
+    return params;
+}
+
+MockTileServer::MockTileServer(const MockTileServerOptions& options) :
+    options_(options),
+    stop_(false),
+    random_(std::random_device()()),
+    tokens_(options.throttleRate),
+    lastRefill_(steady_clock::now()),
+    inFlight_(0),
+    requests_(0),
+    tilesServed_(0),
+    errors_(0),
+    throttled_(0),
+    rejected_(0),
+    bytesSent_(0)
+{
+    // The tiles have the texture of the synthetic images, so that they compress and decode like imagery
+    cv::RNG rng(TILE_VARIANTS);
+    for(int i = 0; i < TILE_VARIANTS; ++i) {
+        cv::Mat tile(TILE_SIZE, TILE_SIZE, CV_8UC3);
+        for(int y = 0; y < TILE_SIZE; y += FIELD_SIZE) {
+            for(int x = 0; x < TILE_SIZE; x += FIELD_SIZE) {
+                cv::Scalar color(rng.uniform(32, 192), rng.uniform(32, 192), rng.uniform(32, 192));
+                tile(cv::Rect(x, y, FIELD_SIZE, FIELD_SIZE)) = color;
+            }
+        }
+
+        cv::Mat noise(tile.size(), tile.type());
+        rng.fill(noise, cv::RNG::UNIFORM, 0, 32);
+        tile += noise;
+
+        vector<uchar> buffer;
+        DG_CHECK(cv::imencode(".jpg", tile, buffer), "Unable to encode a tile");
+        tiles_.emplace_back(buffer.begin(), buffer.end());
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t) options_.port);
+
+    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    DG_CHECK(listenFd_ >= 0, "Unable to create a socket: %s", strerror(errno));
+
+    int reuse = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if(bind(listenFd_, (sockaddr*) &address, sizeof(address)) != 0 || listen(listenFd_, SOMAXCONN) != 0) {
+        auto error = errno;
+        close(listenFd_);
+        DG_ERROR_THROW("Unable to listen on port %d: %s", options_.port, strerror(error));
+    }
+
+    socklen_t length = sizeof(address);
+    getsockname(listenFd_, (sockaddr*) &address, &length);
+    port_ = ntohs(address.sin_port);
+
+    acceptThread_ = thread(&MockTileServer::acceptConnections, this);
+    OSN_LOG(info) << "Mock tile server listening on " << url();
+}
+
+MockTileServer::~MockTileServer()
+{
+    stop_ = true;
+    shutdown(listenFd_, SHUT_RDWR);
+    if(acceptThread_.joinable()) {
+        acceptThread_.join();
+    }
+    close(listenFd_);
+
+    map<thread::id, thread> connectionThreads;
+    {
+        lock_guard<mutex> lock(connectionMutex_);
+        for(auto fd : connectionFds_) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        connectionThreads.swap(connectionThreads_);
+    }
+
+    for(auto& connectionThread : connectionThreads) {
+        connectionThread.second.join();
+    }
+}
+
+string MockTileServer::url() const
+{
+    return (format("http://127.0.0.1:%d/tiles") % port_).str();
+}
+
+Json::Value MockTileServer::stats() const
+{
+    Json::Value stats;
+    stats["requests"] = (Json::Int64) requests_;
+    stats["tiles"] = (Json::Int64) tilesServed_;
+    stats["errors"] = (Json::Int64) errors_;
+    stats["throttled"] = (Json::Int64) throttled_;
+    stats["rejected"] = (Json::Int64) rejected_;
+    stats["bytes"] = (Json::Int64) bytesSent_;
+    return stats;
+}
+
+void MockTileServer::wait()
+{
+    if(acceptThread_.joinable()) {
+        acceptThread_.join();
+    }
+}
+
+void MockTileServer::acceptConnections()
+{
+    while(!stop_) {
+        int fd = accept(listenFd_, nullptr, nullptr);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if(!stop_) {
+                OSN_LOG(error) << "Mock tile server stopped accepting connections: " << strerror(errno);
+            }
+            return;
+        }
+
+        lock_guard<mutex> lock(connectionMutex_);
+        if(stop_) {
+            close(fd);
+            return;
+        }
+        reapConnections();
+        connectionFds_.insert(fd);
+        thread connectionThread(&MockTileServer::serveConnection, this, fd);
+        auto id = connectionThread.get_id();
+        connectionThreads_.emplace(id, move(connectionThread));
+    }
+}
+
+void MockTileServer::reapConnections()
+{
+    // The threads of closed connections are joined as new connections come in, so that a long
+    // benchmark does not keep one finished thread per connection around
+    for(auto id : finishedThreads_) {
+        auto it = connectionThreads_.find(id);
+        if(it != connectionThreads_.end()) {
+            it->second.join();
+            connectionThreads_.erase(it);
+        }
+    }
+    finishedThreads_.clear();
+}
+
+void MockTileServer::serveConnection(int fd)
+{
+    // Connections are kept alive, like the map services do, so that connection reuse is measured too
+    string buffer;
+    char data[4096];
+    bool keepAlive = true;
+    while(keepAlive && !stop_) {
+        auto headerEnd = buffer.find("\r\n\r\n");
+        if(headerEnd == string::npos) {
+            auto ret = recv(fd, data, sizeof(data), 0);
+            if(ret <= 0) {
+                break;
+            }
+            buffer.append(data, ret);
+            continue;
+        }
+
+        auto header = buffer.substr(0, headerEnd);
+        buffer.erase(0, headerEnd + 4);
+
+        vector<string> lines;
+        boost::split(lines, header, boost::is_any_of("\r\n"), boost::token_compress_on);
+        vector<string> requestLine;
+        boost::split(requestLine, lines.front(), boost::is_any_of(" "), boost::token_compress_on);
+
+        Response response;
+        if(requestLine.size() != 3 || requestLine[0] != "GET") {
+            response.status = 400;
+            keepAlive = false;
+        } else {
+            keepAlive = requestLine[2] == "HTTP/1.1";
+            for(size_t i = 1; i < lines.size(); ++i) {
+                auto line = to_lower_copy(lines[i]);
+                if(boost::starts_with(line, "connection:")) {
+                    keepAlive = line.find("close") == string::npos;
+                }
+            }
+
+            ++requests_;
+            response = handle(requestLine[1]);
+        }
+
+        std::ostringstream out;
+        out << "HTTP/1.1 " << response.status << " " << statusText(response.status) << "\r\n";
+        if(!response.contentType.empty()) {
+            out << "Content-Type: " << response.contentType << "\r\n";
+        }
+        if(response.status == 429 || response.status == 503) {
+            out << "Retry-After: 1\r\n";
+        }
+        out << "Content-Length: " << response.body.size() << "\r\n";
+        out << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n\r\n";
+        out << response.body;
+
+        auto message = out.str();
+        if(!sendAll(fd, message)) {
+            break;
+        }
+        bytesSent_ += message.size();
+    }
+
+    lock_guard<mutex> lock(connectionMutex_);
+    connectionFds_.erase(fd);
+    close(fd);
+    finishedThreads_.push_back(std::this_thread::get_id());
+}
+
+MockTileServer::Response MockTileServer::handle(const string& target)
+{
+    auto queryStart = target.find('?');
+    auto path = target.substr(0, queryStart);
+    auto query = queryStart == string::npos ? string() : target.substr(queryStart + 1);
+
+    Response response;
+    try {
+        if(path == "/tiles.json") {
+            response.contentType = "application/json";
+            response.body = tileJson();
+            return response;
+        }
+
+        // Tiles of the TileJSON document: /tiles/{z}/{x}/{y}.jpg
+        vector<string> parts;
+        boost::split(parts, path, boost::is_any_of("/"));
+        if(parts.size() == 5 && parts[1] == "tiles") {
+            auto y = parts[4].substr(0, parts[4].find('.'));
+            return serveTile(lexical_cast<int>(parts[2]), lexical_cast<int>(parts[3]), lexical_cast<int>(y));
+        }
+
+        if(path == "/wmts" || path == "/wmts/1.0.0/WMTSCapabilities.xml") {
+            auto params = parseQuery(query);
+            if(to_upper_copy(params["REQUEST"]) == "GETTILE") {
+                // The tile matrix identifiers are "EPSG:3857:{z}"
+                auto matrix = params["TILEMATRIX"];
+                auto zoom = matrix.substr(matrix.rfind(':') + 1);
+                return serveTile(lexical_cast<int>(zoom), lexical_cast<int>(params["TILECOL"]),
+                                 lexical_cast<int>(params["TILEROW"]));
+            }
+
+            response.contentType = "application/xml";
+            response.body = capabilities();
+            return response;
+        }
+    } catch(const boost::bad_lexical_cast&) {
+        response.status = 400;
+        return response;
+    }
+
+    response.status = 404;
+    return response;
+}
+
+MockTileServer::Response MockTileServer::serveTile(int zoom, int x, int y)
+{
+    Response response;
+    if(zoom < 0 || zoom > MAX_ZOOM || x < 0 || y < 0 || x >= (1 << zoom) || y >= (1 << zoom)) {
+        response.status = 404;
+        return response;
+    }
+
+    struct InFlight
+    {
+        std::atomic<int>& count;
+        explicit InFlight(std::atomic<int>& count) : count(count) { ++count; }
+        ~InFlight() { --count; }
+    } inFlight(inFlight_);
+
+    if(options_.maxConcurrent > 0 && inFlight_ > options_.maxConcurrent) {
+        ++rejected_;
+        response.status = 503;
+        return response;
+    }
+
+    if(!takeToken()) {
+        ++throttled_;
+        response.status = 429;
+        return response;
+    }
+
+    auto delay = delayMs();
+    if(delay > 0) {
+        std::this_thread::sleep_for(milliseconds(delay));
+    }
+
+    if(injectError()) {
+        ++errors_;
+        response.status = 500;
+        return response;
+    }
+
+    ++tilesServed_;
+    response.contentType = "image/jpeg";
+    response.body = tiles_[(x * 7 + y * 13 + zoom) % TILE_VARIANTS];
+    return response;
+}
+
+bool MockTileServer::takeToken()
+{
+    if(options_.throttleRate <= 0) {
+        return true;
+    }
+
+    // Token bucket that allows bursts of up to one second worth of requests
+    lock_guard<mutex> lock(stateMutex_);
+    auto now = steady_clock::now();
+    duration<double> elapsed = now - lastRefill_;
+    lastRefill_ = now;
+    tokens_ = std::min(options_.throttleRate, tokens_ + elapsed.count() * options_.throttleRate);
+    if(tokens_ < 1) {
+        return false;
+    }
+
+    tokens_ -= 1;
+    return true;
+}
+
+int MockTileServer::delayMs()
+{
+    if(options_.jitterMs <= 0) {
+        return options_.latencyMs;
+    }
+
+    lock_guard<mutex> lock(stateMutex_);
+    std::uniform_int_distribution<int> jitter(-options_.jitterMs, options_.jitterMs);
+    return std::max(options_.latencyMs + jitter(random_), 0);
+}
+
+bool MockTileServer::injectError()
+{
+    if(options_.errorRate <= 0) {
+        return false;
+    }
+
+    lock_guard<mutex> lock(stateMutex_);
+    std::uniform_real_distribution<float> percent(0, 100);
+    return percent(random_) < options_.errorRate;
+}
+
+string MockTileServer::tileJson() const
+{
+    Json::Value root;
+    root["tilejson"] = "2.2.0";
+    root["name"] = "OpenSpaceNet mock tiles";
+    root["scheme"] = "xyz";
+    root["format"] = "jpg";
+    root["minzoom"] = 0;
+    root["maxzoom"] = MAX_ZOOM;
+    root["tiles"].append(url() + "/{z}/{x}/{y}.jpg");
+
+    auto& bounds = root["bounds"];
+    bounds.append(-180.0);
+    bounds.append(-85.0511);
+    bounds.append(180.0);
+    bounds.append(85.0511);
+
+    Json::StreamWriterBuilder builder;
+    return Json::writeString(builder, root);
+}
+
+string MockTileServer::capabilities() const
+{
+    auto serviceUrl = (format("http://127.0.0.1:%d/wmts?") % port_).str();
+
+    std::ostringstream out;
+    out << std::setprecision(15);
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<Capabilities xmlns=\"http://www.opengis.net/wmts/1.0\" xmlns:ows=\"http://www.opengis.net/ows/1.1\" "
+        << "xmlns:xlink=\"http://www.w3.org/1999/xlink\" version=\"1.0.0\">\n"
+        << "  <ows:OperationsMetadata>\n";
+    for(const char* operation : { "GetCapabilities", "GetTile" }) {
+        out << "    <ows:Operation name=\"" << operation << "\"><ows:DCP><ows:HTTP><ows:Get xlink:href=\""
+            << serviceUrl << "\"><ows:Constraint name=\"GetEncoding\"><ows:AllowedValues><ows:Value>KVP"
+            << "</ows:Value></ows:AllowedValues></ows:Constraint></ows:Get></ows:HTTP></ows:DCP></ows:Operation>\n";
+    }
+    out << "  </ows:OperationsMetadata>\n"
+        << "  <Contents>\n"
+        << "    <Layer>\n"
+        << "      <ows:Identifier>DigitalGlobe:ImageryTileService</ows:Identifier>\n"
+        << "      <ows:WGS84BoundingBox><ows:LowerCorner>-180 -85.0511</ows:LowerCorner>"
+        << "<ows:UpperCorner>180 85.0511</ows:UpperCorner></ows:WGS84BoundingBox>\n"
+        << "      <Style isDefault=\"true\"><ows:Identifier>default</ows:Identifier></Style>\n"
+        << "      <Format>image/jpeg</Format>\n"
+        << "      <TileMatrixSetLink><TileMatrixSet>EPSG:3857</TileMatrixSet></TileMatrixSetLink>\n"
+        << "    </Layer>\n"
+        << "    <TileMatrixSet>\n"
+        << "      <ows:Identifier>EPSG:3857</ows:Identifier>\n"
+        << "      <ows:SupportedCRS>urn:ogc:def:crs:EPSG::3857</ows:SupportedCRS>\n";
+    for(int zoom = 0; zoom <= MAX_ZOOM; ++zoom) {
+        out << "      <TileMatrix><ows:Identifier>EPSG:3857:" << zoom << "</ows:Identifier>"
+            << "<ScaleDenominator>" << SCALE_DENOMINATOR / (1 << zoom) << "</ScaleDenominator>"
+            << "<TopLeftCorner>" << -MERCATOR_EXTENT << " " << MERCATOR_EXTENT << "</TopLeftCorner>"
+            << "<TileWidth>" << TILE_SIZE << "</TileWidth><TileHeight>" << TILE_SIZE << "</TileHeight>"
+            << "<MatrixWidth>" << (1 << zoom) << "</MatrixWidth><MatrixHeight>" << (1 << zoom) << "</MatrixHeight>"
+            << "</TileMatrix>\n";
+    }
+    out << "    </TileMatrixSet>\n"
+        << "  </Contents>\n"
+        << "</Capabilities>\n";
+    return out.str();
+}
+
+} } // namespace dg { namespace osn {
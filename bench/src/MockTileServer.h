@@ -0,0 +1,121 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef OPENSPACENET_MOCKTILESERVER_H
+#define OPENSPACENET_MOCKTILESERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <json/json.h>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dg { namespace osn {
+
+struct MockTileServerOptions
+{
+    // Port to listen on, 0 to pick a free one
+    int port = 0;
+
+    // Every request is delayed by the latency, plus or minus a random jitter
+    int latencyMs = 0;
+    int jitterMs = 0;
+
+    // Percent of the tile requests that fail with an internal server error
+    float errorRate = 0;
+
+    // Tile requests per second above which requests are answered with "429 Too Many Requests", 0 for no limit
+    double throttleRate = 0;
+
+    // Concurrent tile requests above which requests are answered with "503 Service Unavailable", 0 for no limit
+    int maxConcurrent = 0;
+};
+
+//
+// A local HTTP server that stands in for the map services. It serves synthetic JPEG tiles in the
+// web mercator tile grid, a TileJSON document for them at /tiles.json, and WMTS capabilities and
+// tiles at /wmts. Latency, failures and throttling can be injected to see how the downloads cope.
+//
+class MockTileServer
+{
+public:
+    explicit MockTileServer(const MockTileServerOptions& options);
+    ~MockTileServer();
+
+    // The URL to pass to the tile-json service
+    std::string url() const;
+
+    // Counts of the requests served so far
+    Json::Value stats() const;
+
+    // Blocks until the server fails
+    void wait();
+
+private:
+    struct Response
+    {
+        int status = 200;
+        std::string contentType;
+        std::string body;
+    };
+
+    void acceptConnections();
+    void serveConnection(int fd);
+    void reapConnections();
+    Response handle(const std::string& target);
+    Response serveTile(int zoom, int x, int y);
+    bool takeToken();
+    int delayMs();
+    bool injectError();
+
+    std::string tileJson() const;
+    std::string capabilities() const;
+
+    MockTileServerOptions options_;
+    int listenFd_ = -1;
+    int port_ = 0;
+    std::vector<std::string> tiles_;
+
+    std::atomic<bool> stop_;
+    std::thread acceptThread_;
+    std::mutex connectionMutex_;
+    std::set<int> connectionFds_;
+    std::map<std::thread::id, std::thread> connectionThreads_;
+    std::vector<std::thread::id> finishedThreads_;
+
+    std::mutex stateMutex_;
+    std::mt19937 random_;
+    double tokens_ = 0;
+    std::chrono::steady_clock::time_point lastRefill_;
+
+    std::atomic<int> inFlight_;
+    std::atomic<int64_t> requests_;
+    std::atomic<int64_t> tilesServed_;
+    std::atomic<int64_t> errors_;
+    std::atomic<int64_t> throttled_;
+    std::atomic<int64_t> rejected_;
+    std::atomic<int64_t> bytesSent_;
+};
+
+} } // namespace dg { namespace osn {
+
+#endif //OPENSPACENET_MOCKTILESERVER_H
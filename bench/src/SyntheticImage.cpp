@@ -0,0 +1,153 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "SyntheticImage.h"
+
+#include <boost/lexical_cast.hpp>
+#include <cstdint>
+#include <gdal_priv.h>
+#include <memory>
+#include <ogr_spatialref.h>
+#include <ogrsf_frmts.h>
+#include <utility/Logging.h>
+#include <vector>
+
+namespace dg { namespace osn {
+
+using boost::lexical_cast;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+const double SyntheticImage::PIXEL_SIZE = 5e-6;
+
+// Upper left corner of the generated images
+static const double ORIGIN_X = -105.0;
+static const double ORIGIN_Y = 40.0;
+
+// Side of the uniform fields that the image texture is made of, in pixels
+static const int FIELD_SIZE = 64;
+
+// Number of rows written at once for striped images
+static const int STRIP_ROWS = 256;
+
+static void closeDataset(GDALDataset* dataset)
+{
+    GDALClose(dataset);
+}
+
+// Reproducible pseudo-random value of a position
+static uint32_t hash(uint32_t x, uint32_t y, uint32_t z)
+{
+    uint32_t h = x * 374761393u + y * 668265263u + z * 2147483647u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return h ^ (h >> 16);
+}
+
+void SyntheticImage::create(const string& path, const SyntheticImageSpec& spec)
+{
+    GDALAllRegister();
+
+    auto driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+    DG_CHECK(driver, "GDAL driver GTiff is not available");
+
+    char** options = nullptr;
+    options = CSLSetNameValue(options, "COMPRESS", spec.compression.c_str());
+    options = CSLSetNameValue(options, "BIGTIFF", "IF_SAFER");
+    if(spec.blockSize > 0) {
+        auto blockSize = lexical_cast<string>(spec.blockSize);
+        options = CSLSetNameValue(options, "TILED", "YES");
+        options = CSLSetNameValue(options, "BLOCKXSIZE", blockSize.c_str());
+        options = CSLSetNameValue(options, "BLOCKYSIZE", blockSize.c_str());
+    } else {
+        options = CSLSetNameValue(options, "BLOCKYSIZE", "1");
+    }
+
+    unique_ptr<GDALDataset, void (*)(GDALDataset*)> dataset(
+        driver->Create(path.c_str(), spec.size.width, spec.size.height, spec.bands, GDT_Byte, options),
+        closeDataset);
+    CSLDestroy(options);
+    DG_CHECK(dataset, "Unable to create %s", path.c_str());
+
+    double geoTransform[6] = { ORIGIN_X, PIXEL_SIZE, 0, ORIGIN_Y, 0, -PIXEL_SIZE };
+    dataset->SetGeoTransform(geoTransform);
+
+    OGRSpatialReference sr;
+    sr.SetWellKnownGeogCS("WGS84");
+    char* wkt = nullptr;
+    sr.exportToWkt(&wkt);
+    dataset->SetProjection(wkt);
+    CPLFree(wkt);
+
+    // Every field has its own brightness in each band, with a little noise on top of it
+    int rows = spec.blockSize > 0 ? spec.blockSize : STRIP_ROWS;
+    vector<uint8_t> buffer((size_t) spec.size.width * rows * spec.bands);
+    for(int y0 = 0; y0 < spec.size.height; y0 += rows) {
+        int height = std::min(rows, spec.size.height - y0);
+        for(int band = 0; band < spec.bands; ++band) {
+            auto bandData = buffer.data() + (size_t) band * spec.size.width * height;
+            for(int y = 0; y < height; ++y) {
+                auto row = bandData + (size_t) y * spec.size.width;
+                for(int x = 0; x < spec.size.width; ++x) {
+                    auto field = hash(x / FIELD_SIZE, (y0 + y) / FIELD_SIZE, band);
+                    auto noise = hash(x, y0 + y, band) % 32;
+                    row[x] = (uint8_t) (32 + field % 160 + noise);
+                }
+            }
+        }
+
+        auto err = dataset->RasterIO(GF_Write, 0, y0, spec.size.width, height, buffer.data(),
+                                     spec.size.width, height, GDT_Byte, spec.bands, nullptr, 0, 0, 0);
+        DG_CHECK(err == CE_None, "Unable to write %s", path.c_str());
+    }
+}
+
+void SyntheticImage::createIncludeRegion(const string& path, const SyntheticImageSpec& spec, double fraction)
+{
+    GDALAllRegister();
+
+    auto driver = GetGDALDriverManager()->GetDriverByName("GeoJSON");
+    DG_CHECK(driver, "GDAL driver GeoJSON is not available");
+
+    unique_ptr<GDALDataset, void (*)(GDALDataset*)> dataset(
+        driver->Create(path.c_str(), 0, 0, 0, GDT_Unknown, nullptr), closeDataset);
+    DG_CHECK(dataset, "Unable to create %s", path.c_str());
+
+    OGRSpatialReference sr;
+    sr.SetWellKnownGeogCS("WGS84");
+    auto layer = dataset->CreateLayer("include", &sr, wkbPolygon);
+    DG_CHECK(layer, "Unable to create a layer in %s", path.c_str());
+
+    auto right = ORIGIN_X + fraction * spec.size.width * PIXEL_SIZE;
+    auto bottom = ORIGIN_Y - spec.size.height * PIXEL_SIZE;
+
+    OGRLinearRing ring;
+    ring.addPoint(ORIGIN_X, ORIGIN_Y);
+    ring.addPoint(right, ORIGIN_Y);
+    ring.addPoint(right, bottom);
+    ring.addPoint(ORIGIN_X, bottom);
+    ring.closeRings();
+
+    OGRPolygon polygon;
+    polygon.addRing(&ring);
+
+    unique_ptr<OGRFeature, void (*)(OGRFeature*)> feature(OGRFeature::CreateFeature(layer->GetLayerDefn()),
+                                                          OGRFeature::DestroyFeature);
+    feature->SetGeometry(&polygon);
+    DG_CHECK(layer->CreateFeature(feature.get()) == OGRERR_NONE, "Unable to write %s", path.c_str());
+}
+
+} } // namespace dg { namespace osn {
@@ -0,0 +1,54 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef OPENSPACENET_SYNTHETICIMAGE_H
+#define OPENSPACENET_SYNTHETICIMAGE_H
+
+#include <opencv2/core/types.hpp>
+#include <string>
+
+namespace dg { namespace osn {
+
+//
+// Layout of a generated GeoTIFF. A block size of 0 writes the image in strips of one row.
+//
+struct SyntheticImageSpec
+{
+    cv::Size size = cv::Size(8192, 8192);
+    int bands = 3;
+    int blockSize = 256;
+    std::string compression = "NONE";
+};
+
+//
+// Writes 8-bit GeoTIFFs in WGS84 with a textured, reproducible content, so that compression and
+// chip screening behave as they would on real imagery
+//
+class SyntheticImage
+{
+public:
+    static void create(const std::string& path, const SyntheticImageSpec& spec);
+
+    // Writes a GeoJSON polygon that covers the given fraction of the image, starting at the left edge
+    static void createIncludeRegion(const std::string& path, const SyntheticImageSpec& spec, double fraction);
+
+    // Ground sample distance of the generated images, in degrees
+    static const double PIXEL_SIZE;
+};
+
+} } // namespace dg { namespace osn {
+
+#endif //OPENSPACENET_SYNTHETICIMAGE_H
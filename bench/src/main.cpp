@@ -0,0 +1,237 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "Benchmark.h"
+#include <OpenSpaceNetArgs.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <utility/Logging.h>
+#include <utility/program_options.hpp>
+
+using namespace dg::osn;
+using namespace dg::deepcore;
+
+namespace po = boost::program_options;
+
+using boost::program_options::name_with_default;
+using std::cerr;
+using std::exception;
+using std::string;
+
+template<class T>
+static bool readVariable(const char* param, const po::variables_map& vm, T& ret)
+{
+    auto it = vm.find(param);
+    if(it != vm.end()) {
+        ret = it->second.as<T>();
+        return true;
+    }
+
+    return false;
+}
+
+static BenchmarkArgs parseArgs(int argc, const char* const* argv, bool& showHelp, bool& serveTiles)
+{
+    BenchmarkArgs args;
+
+    po::options_description imageOptions("Image Options");
+    imageOptions.add_options()
+        ("width", po::value<int>()->value_name(name_with_default("PIXELS", args.image.size.width)),
+         "Width of the generated image.")
+        ("height", po::value<int>()->value_name(name_with_default("PIXELS", args.image.size.height)),
+         "Height of the generated image.")
+        ("bands", po::value<int>()->value_name(name_with_default("BANDS", args.image.bands)),
+         "Number of bands of the generated image.")
+        ("block-size", po::value<int>()->value_name(name_with_default("PIXELS", args.image.blockSize)),
+         "Side of the square tiles of the generated image, 0 to write it in strips of one row.")
+        ("compression", po::value<string>()->value_name(name_with_default("METHOD", args.image.compression)),
+         "GeoTIFF compression of the generated image: NONE, LZW, DEFLATE, or JPEG.")
+        ("include-fraction", po::value<double>()->value_name("FRACTION"),
+         "Process only this fraction of the image, selected by an include region filter.")
+        ;
+
+    po::options_description processingOptions("Processing Options");
+    processingOptions.add_options()
+        ("model", po::value<std::vector<string>>()->multitoken()->value_name("PATH [PATH...]"),
+         "Model packages to run. Small models show the throughput of the rest of the pipeline best.")
+        ("gpu", "Run the models on the GPU. The models run on the CPU by default.")
+        ("window-size", po::value<std::vector<int>>()->multitoken()->value_name("SIZE [SIZE...]"),
+         "Sliding window detection box sizes. Default is the model size.")
+        ("window-step", po::value<std::vector<int>>()->multitoken()->value_name("STEP [STEP...]"),
+         "Sliding window step. Default is 20% of the model size.")
+        ("batch-size", po::value<int>()->value_name("SIZE"),
+         "Number of windows the models process at once.")
+        ("inference-workers", po::value<int>()->value_name(name_with_default("WORKERS", args.inferenceWorkers)),
+         "Number of model replicas that process the image in parallel.")
+        ("confidence", po::value<float>()->value_name(name_with_default("PERCENT", args.confidence)),
+         "Minimum percent score for results to be included in the output.")
+        ("nms", po::bounded_value<std::vector<float>>()->min_tokens(0)->max_tokens(1)->value_name(name_with_default("PERCENT", args.overlap)),
+         "Perform non-maximum suppression on the output, with an optional overlap threshold percentage.")
+        ("format", po::value<string>()->value_name(name_with_default("FORMAT", args.outputFormat)),
+         "Output file format: shp, geojson, kml, or csv.")
+        ;
+
+    po::options_description serviceOptions("Map Service Options");
+    serviceOptions.add_options()
+        ("map-service", "Download the image from a local mock map service through the tile-json service, "
+         "instead of generating an image.")
+        ("serve-tiles", po::value<int>()->value_name("PORT"),
+         "Only run the mock map service on this port, until the process is stopped. Its URL can be passed to "
+         "OpenSpaceNet --service tile-json --url.")
+        ("zoom", po::value<int>()->value_name(name_with_default("ZOOM", args.zoom)),
+         "Zoom level of the downloaded tiles.")
+        ("tiles", po::value<int>()->value_name(name_with_default("TILES", args.tiles)),
+         "Side of the downloaded area, in tiles.")
+        ("max-connections", po::value<int>()->value_name(name_with_default("NUM", args.maxConnections)),
+         "Number of tiles downloaded simultaneously.")
+        ("adaptive-connections", "Adapt the number of simultaneous downloads, up to max-connections.")
+        ("latency", po::value<int>()->value_name(name_with_default("MS", args.server.latencyMs)),
+         "Delay of every tile response, in milliseconds.")
+        ("jitter", po::value<int>()->value_name(name_with_default("MS", args.server.jitterMs)),
+         "Random variation of the delay, in milliseconds.")
+        ("error-rate", po::value<float>()->value_name(name_with_default("PERCENT", args.server.errorRate)),
+         "Percent of the tile requests that fail with an internal server error.")
+        ("throttle-rate", po::value<double>()->value_name("REQUESTS"),
+         "Tile requests per second above which the server answers \"429 Too Many Requests\".")
+        ("max-concurrent", po::value<int>()->value_name("NUM"),
+         "Concurrent tile requests above which the server answers \"503 Service Unavailable\".")
+        ;
+
+    po::options_description benchmarkOptions("Benchmark Options");
+    benchmarkOptions.add_options()
+        ("runs", po::value<int>()->value_name(name_with_default("RUNS", args.runs)),
+         "Number of times the image is processed.")
+        ("work-dir", po::value<string>()->value_name("PATH"),
+         "Directory for the generated image and the output. Default is a new temporary directory.")
+        ("keep-files", "Do not delete the generated image and the output.")
+        ("out", po::value<string>()->value_name("PATH"),
+         "Write the results to this file instead of the standard output.")
+        ("help", "Show this help message")
+        ;
+
+    po::options_description options;
+    options.add(imageOptions).add(processingOptions).add(serviceOptions).add(benchmarkOptions);
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+
+    showHelp = vm.find("help") != vm.end() || argc == 1;
+    if(showHelp) {
+        cerr << "Usage: osn_bench --model PATH [PATH...] [options]\n"
+                "       osn_bench --serve-tiles PORT [options]\n\n" << options;
+        return args;
+    }
+
+    readVariable("width", vm, args.image.size.width);
+    readVariable("height", vm, args.image.size.height);
+    readVariable("bands", vm, args.image.bands);
+    readVariable("block-size", vm, args.image.blockSize);
+    if(readVariable("compression", vm, args.image.compression)) {
+        boost::to_upper(args.image.compression);
+    }
+    readVariable("include-fraction", vm, args.includeFraction);
+
+    readVariable("model", vm, args.modelPaths);
+    args.useCpu = vm.find("gpu") == vm.end();
+    readVariable("window-size", vm, args.windowSize);
+    readVariable("window-step", vm, args.windowStep);
+    readVariable("batch-size", vm, args.batchSize);
+    readVariable("inference-workers", vm, args.inferenceWorkers);
+    readVariable("confidence", vm, args.confidence);
+    std::vector<float> overlap;
+    if(readVariable("nms", vm, overlap)) {
+        args.nms = true;
+        if(!overlap.empty()) {
+            args.overlap = overlap.front();
+        }
+    }
+    if(readVariable("format", vm, args.outputFormat)) {
+        boost::to_lower(args.outputFormat);
+    }
+
+    args.mapService = vm.find("map-service") != vm.end();
+    readVariable("serve-tiles", vm, args.server.port);
+    readVariable("zoom", vm, args.zoom);
+    readVariable("tiles", vm, args.tiles);
+    readVariable("max-connections", vm, args.maxConnections);
+    args.adaptiveConnections = vm.find("adaptive-connections") != vm.end();
+    readVariable("latency", vm, args.server.latencyMs);
+    readVariable("jitter", vm, args.server.jitterMs);
+    readVariable("error-rate", vm, args.server.errorRate);
+    readVariable("throttle-rate", vm, args.server.throttleRate);
+    readVariable("max-concurrent", vm, args.server.maxConcurrent);
+
+    DG_CHECK(args.server.latencyMs >= 0 && args.server.jitterMs >= 0, "The latency and jitter must not be negative");
+    DG_CHECK(args.server.errorRate >= 0 && args.server.errorRate <= 100, "The error rate must be between 0 and 100");
+    if(vm.find("serve-tiles") != vm.end()) {
+        DG_CHECK(args.server.port > 0 && args.server.port < 65536, "Invalid port: %d", args.server.port);
+        serveTiles = true;
+        return args;
+    }
+
+    readVariable("runs", vm, args.runs);
+    readVariable("work-dir", vm, args.workDir);
+    args.keepFiles = vm.find("keep-files") != vm.end();
+    readVariable("out", vm, args.resultsPath);
+
+    DG_CHECK(!args.modelPaths.empty(), "At least one model must be specified with --model");
+    DG_CHECK(args.image.size.width > 0 && args.image.size.height > 0, "The image size must be positive");
+    DG_CHECK(args.image.bands > 0, "The number of bands must be positive");
+    DG_CHECK(args.image.blockSize == 0 || args.image.blockSize % 16 == 0,
+             "The block size must be a multiple of 16");
+    DG_CHECK(args.includeFraction >= 0 && args.includeFraction <= 1, "The include fraction must be between 0 and 1");
+    DG_CHECK(args.runs > 0, "The number of runs must be positive");
+    DG_CHECK(args.inferenceWorkers > 0, "The number of inference workers must be positive");
+    if(args.mapService) {
+        DG_CHECK(args.zoom >= 0 && args.zoom <= 22, "The zoom level must be between 0 and 22");
+        DG_CHECK(args.tiles > 0 && args.tiles <= (1 << args.zoom), "Invalid number of tiles: %d", args.tiles);
+        DG_CHECK(args.maxConnections > 0, "The number of connections must be positive");
+        DG_CHECK(args.includeFraction == 0, "Argument --include-fraction is not supported with --map-service");
+    }
+
+    return args;
+}
+
+int main(int argc, const char* const* argv)
+{
+    // The results are written to the standard output, so all of the log goes to the standard error
+    log::init();
+    log::addCerrSink(level_t::info, level_t::fatal, log::dg_log_format::dg_short_log);
+
+    try {
+        bool showHelp = false;
+        bool serveTiles = false;
+        auto args = parseArgs(argc, argv, showHelp, serveTiles);
+        if(serveTiles) {
+            MockTileServer server(args.server);
+            server.wait();
+        } else if(!showHelp) {
+            Benchmark benchmark(std::move(args));
+            benchmark.run();
+        }
+    } catch (const Error& e) {
+        DG_ERROR_LOG(OpenSpaceNet, e);
+        return 1;
+    } catch (const exception &e) {
+        OSN_LOG(error) << e.what();
+        return 1;
+    } catch (...) {
+        OSN_LOG(error) << "Unknown error.";
+        return 1;
+    }
+}
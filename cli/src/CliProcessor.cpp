@@ -16,6 +16,7 @@
 ********************************************************************************/
 #include "CliProcessor.h"
 
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/path.hpp>
@@ -25,7 +26,6 @@
 #include <boost/range/adaptor/reversed.hpp>
 #include <boost/tokenizer.hpp>
 #include <classification/Classification.h>
-#include <classification/GbdxModelReader.h>
 #include <fstream>
 #include <geometry/cv_program_options.hpp>
 #include <iomanip>
@@ -68,13 +68,18 @@ using std::unique_ptr;
 using geometry::GeometryType;
 using dg::deepcore::ConsoleProgressDisplay;
 using dg::deepcore::ProgressCategory;
-using dg::deepcore::classification::GbdxModelReader;
 using dg::deepcore::imagery::RasterToPolygonDP;
 using dg::deepcore::vector::FileFeatureSet;
 
+static const int DEFAULT_CHECKPOINT_STRIPS = 16;
+static const char* DEFAULT_TILE_CACHE_SIZE = "10G";
+
 static const string OSN_USAGE =
     "Usage:\n"
         "  OpenSpaceNet <options>\n"
+        "  OpenSpaceNet batch --manifest <manifest file> <options>\n"
+        "  OpenSpaceNet serve --socket <socket path> [options]\n"
+        "  OpenSpaceNet merge --inputs <shard outputs> --output <output path> [options]\n"
         "  OpenSpaceNet --config <configuration file> [other options]\n\n";
 
 CliProcessor::CliProcessor() :
@@ -85,6 +90,10 @@ CliProcessor::CliProcessor() :
     detectOptions_("Feature Detection Options"),
     segmentationOptions_("Segmentation Options"),
     filterOptions_("Filtering Options"),
+    cascadeOptions_("Cascade Options"),
+    batchOptions_("Batch Options"),
+    serverOptions_("Server Options"),
+    mergeOptions_("Merge Options"),
     loggingOptions_("Logging Options"),
     generalOptions_("General Options"),
     supportedFormats_(FileFeatureSet::supportedFormats())
@@ -121,6 +130,13 @@ CliProcessor::CliProcessor() :
         ("map-id", po::value<string>()->value_name(name_with_default("MAPID", osnArgs.mapId)), "MapsAPI map id to use.")
         ("max-connections", po::value<int>()->value_name(name_with_default("NUM", osnArgs.maxConnections)),
          "Used to speed up downloads by allowing multiple concurrent downloads to happen at once.")
+        ("adaptive-connections", "Adapt the number of concurrent downloads to the service and the model while "
+         "processing, up to --max-connections.")
+        ("tile-cache", po::value<string>()->value_name("PATH"),
+         "Directory of a persistent tile cache. Downloaded tiles are stored in the cache, and are not downloaded "
+         "again by later runs over the same area.")
+        ("tile-cache-size", po::value<string>()->value_name(name_with_default("SIZE", DEFAULT_TILE_CACHE_SIZE)),
+         "Maximum size of the tile cache, e.g. 10G. The oldest tiles are removed when the cache grows larger.")
         ;
 
     string outputDescription = "Output file format for the results. Valid values are: ";
@@ -153,7 +169,15 @@ CliProcessor::CliProcessor() :
         ("cpu", "Use the CPU for processing, the default is to use the GPU.")
         ("max-utilization", po::value<float>()->value_name(name_with_default("PERCENT", osnArgs.maxUtilization)),
          "Maximum GPU utilization %. Minimum is 5, and maximum is 100. Not used if processing on CPU")
-        ("model", po::value<string>()->value_name("PATH"), "Path to the the trained model.")
+        ("inference-workers", po::value<int>()->value_name(name_with_default("NUM", osnArgs.inferenceWorkers)),
+         "Number of inference workers. Every worker runs its own replica of the model on a part of the area of "
+         "interest, which is useful when processing on the CPU.")
+        ("batch-size", po::value<int>()->value_name("SIZE"),
+         "Number of windows passed to the model in one forward pass. The default batch size is chosen from the "
+         "available memory.")
+        ("model", po::value<std::vector<string>>()->multitoken()->value_name("PATH [PATH...]"),
+         "Path to the the trained model. Several models may be specified to run them all in one pass over the "
+         "imagery.")
         ("window-size", po::value<std::vector<int>>()->multitoken()->value_name("SIZE [SIZE...]"),
          "Sliding window detection box sizes.  The source image is chipped with boxes of the given sizes.  "
          "If resampled-size is not specified, all windows must fit within the model."
@@ -167,6 +191,17 @@ CliProcessor::CliProcessor() :
          "Maximum raster cache size. This can be specified as a memory amount, "
          "e.g. 16G, or as a percentage, e.g. 50%. Specifying 0 turns off raster "
          "cache size limiting. The default is 25% of the total physical RAM.")
+        ("shard", po::value<string>()->value_name("INDEX/COUNT"),
+         "Process only one shard of the area of interest, when it is split into COUNT shards. INDEX is zero-based. "
+         "The outputs of all shards can be combined with the merge action.")
+        ("checkpoint", po::bounded_value<std::vector<int>>()->min_tokens(0)->max_tokens(1)->value_name(name_with_default("STRIPS", DEFAULT_CHECKPOINT_STRIPS)),
+         "Process the area of interest in strips, and record every finished strip in a journal next to the output, "
+         "so that an interrupted run can be resumed with --resume.")
+        ("super-tile", po::value<string>()->value_name("SIZE|auto"),
+         "Process the area of interest in square super-tiles of about SIZE pixels, in Hilbert curve order. This "
+         "bounds the raster cache needed for very wide images. With auto, the size is chosen from --max-cache-size.")
+        ("resume", "Resume an interrupted run from its checkpoint journal. Finished strips are skipped, and the "
+         "remaining strips are processed again. Implies --checkpoint.")
         ;
 
     segmentationOptions_.add_options()
@@ -187,6 +222,45 @@ CliProcessor::CliProcessor() :
         ("exclude-region", po::value<string>()->value_name("PATH [PATH...]"), "Path to a file prescribing regions to exclude when filtering.")
         ("region", po::value<std::vector<string>>()->multitoken()->value_name("(include/exclude) PATH [PATH...] [(include/exclude) PATH [PATH...]...]"),
          "Paths to files including and excluding regions.")
+        ("screen", "Skip windows over no-data, transparent, or uniform parts of a local image, such as clouds or "
+         "open water. The image is screened before it is processed.")
+        ("screen-max-invalid", po::value<float>()->value_name(name_with_default("PERCENT", osnArgs.screenMaxInvalid)),
+         "Maximum percentage of no-data or transparent pixels in an image area that is processed. Implies --screen.")
+        ("screen-min-stddev", po::value<float>()->value_name(name_with_default("VALUE", osnArgs.screenMinStdDev)),
+         "Minimum standard deviation of pixel values in an image area that is processed, areas at or below it are "
+         "uniform. Implies --screen.")
+        ;
+
+    cascadeOptions_.add_options()
+        ("cascade", po::bounded_value<std::vector<int>>()->min_tokens(0)->max_tokens(1)->value_name("[STEP]"),
+         "Run a coarse detection pass first, and process full resolution windows only around its detections. The "
+         "coarse window step may be specified, the default is the model size.")
+        ("cascade-confidence", po::value<float>()->value_name(name_with_default("PERCENT", osnArgs.cascadeConfidence)),
+         "Minimum percent score for a coarse pass detection to be processed at full resolution.")
+        ("cascade-model", po::value<string>()->value_name("PATH"),
+         "Lightweight gating model used for the coarse pass. The default is to use the detection models.")
+        ;
+
+    batchOptions_.add_options()
+        ("manifest", po::value<string>()->value_name("PATH"),
+         "Batch manifest file. Each line lists an input image, an output path, and an optional bounding box: "
+         "IMAGE OUTPUT [WEST SOUTH EAST NORTH]. Only used by the batch action.")
+        ;
+
+    serverOptions_.add_options()
+        ("socket", po::value<string>()->value_name("PATH"),
+         "Unix domain socket the server listens on for detection jobs. Only used by the serve action.")
+        ("max-models", po::value<int>()->value_name(name_with_default("NUM", osnArgs.maxModels)),
+         "Maximum number of models the server keeps loaded.")
+        ("max-queued-jobs", po::value<int>()->value_name(name_with_default("NUM", osnArgs.maxQueuedJobs)),
+         "Maximum number of jobs waiting in the server job queue.")
+        ("max-clients", po::value<int>()->value_name(name_with_default("NUM", osnArgs.maxClients)),
+         "Maximum number of clients connected to the server at the same time.")
+        ;
+
+    mergeOptions_.add_options()
+        ("inputs", po::value<std::vector<string>>()->multitoken()->value_name("PATH [PATH...]"),
+         "Outputs of the shards to combine. Only used by the merge action.")
         ;
 
     loggingOptions_.add_options()
@@ -194,6 +268,12 @@ CliProcessor::CliProcessor() :
          "Log to a file, a file name preceded by an optional log level must be specified. Permitted values for log "
          "level are: trace, debug, info, warning, error, fatal.")
         ("quiet", "If set, no output will be sent to console, only a log file, if specified.")
+        ("metrics-out", po::value<string>()->value_name("PATH"),
+         "Periodically write processing metrics to a file, in the Prometheus textfile format if the file name ends "
+         "with .prom, or as JSON otherwise.")
+        ("trace-out", po::value<string>()->value_name("PATH"),
+         "Write a timeline of the processing to a file in the Chrome trace event format, which can be opened in "
+         "Perfetto or chrome://tracing.")
         ;
 
     generalOptions_.add_options()
@@ -210,6 +290,10 @@ CliProcessor::CliProcessor() :
     optionsDescription_.add(processingOptions_);
     optionsDescription_.add(segmentationOptions_);
     optionsDescription_.add(filterOptions_);
+    optionsDescription_.add(cascadeOptions_);
+    optionsDescription_.add(batchOptions_);
+    optionsDescription_.add(serverOptions_);
+    optionsDescription_.add(mergeOptions_);
     optionsDescription_.add(loggingOptions_);
     optionsDescription_.add(generalOptions_);
 
@@ -241,6 +325,10 @@ CliProcessor::CliProcessor() :
     visibleOptions_.add(processingOptions_);
     visibleOptions_.add(segmentationOptions_);
     visibleOptions_.add(filterOptions_);
+    visibleOptions_.add(cascadeOptions_);
+    visibleOptions_.add(batchOptions_);
+    visibleOptions_.add(serverOptions_);
+    visibleOptions_.add(mergeOptions_);
     visibleOptions_.add(loggingOptions_);
     visibleOptions_.add(generalOptions_);
 }
@@ -269,6 +357,16 @@ void CliProcessor::setupArgParsing(int argc, const char* const* argv)
 
 void CliProcessor::startOSNProcessing()
 {
+    if(osnArgs.action == Action::SERVE) {
+        OpenSpaceNetServer server(std::move(osnArgs));
+        server.run();
+        return;
+    } else if(osnArgs.action == Action::MERGE) {
+        ShardMerger merger(std::move(osnArgs));
+        merger.process();
+        return;
+    }
+
     OpenSpaceNet osn(std::move(osnArgs));
 
     auto pd = boost::make_shared<ConsoleProgressDisplay>();
@@ -375,6 +473,12 @@ static Action parseAction(string str)
         return Action::HELP;
     } else if(str == "detect") {
         return Action::DETECT;
+    } else if(str == "batch") {
+        return Action::BATCH;
+    } else if(str == "serve") {
+        return Action::SERVE;
+    } else if(str == "merge") {
+        return Action::MERGE;
     }
 
     return Action::UNKNOWN;
@@ -388,7 +492,8 @@ void CliProcessor::parseArgs(int argc, const char* const* argv)
         if(osnArgs.action == Action::HELP) {
             displayHelp = true;
             return;
-        } else if(osnArgs.action == Action::DETECT) {
+        } else if(osnArgs.action == Action::DETECT || osnArgs.action == Action::BATCH ||
+                  osnArgs.action == Action::SERVE || osnArgs.action == Action::MERGE) {
             --argc;
             ++argv;
         } else {
@@ -476,23 +581,53 @@ inline void checkArgument(const char* argumentName, ArgUse expectedUse, const st
     }
 }
 
-void CliProcessor::readModelPackage()
+void CliProcessor::validateArgs()
 {
-    GbdxModelReader modelReader(osnArgs.modelPath);
+    if (osnArgs.action == Action::HELP || displayHelp) {
+        return;
+    }
 
-    OSN_LOG(info) << "Reading model package..." ;
+    DG_CHECK(osnArgs.action == Action::DETECT || osnArgs.action == Action::BATCH ||
+             osnArgs.action == Action::SERVE || osnArgs.action == Action::MERGE,
+             "Try 'OpenSpaceNet --help' for more information.");
+
+    if(osnArgs.action == Action::MERGE) {
+        // Only the output and NMS options apply when combining shard outputs
+        checkArgument("inputs", REQUIRED, osnArgs.mergeInputs, "using the merge action");
+        checkArgument("output", REQUIRED, osnArgs.outputPath, "using the merge action");
+        if(osnArgs.outputFormat == "shp") {
+            checkArgument("output-layer", IGNORED, osnArgs.layerName, "the output format is a shapefile");
+            osnArgs.layerName = path(osnArgs.outputPath).stem().filename().string();
+        } else if(osnArgs.layerName.empty()) {
+            osnArgs.layerName = "osndetects";
+        }
+        return;
+    }
 
-    osnArgs.modelPackage = modelReader.readModel();
-    DG_CHECK(osnArgs.modelPackage, "Unable to open the model package");
-}
+    checkArgument("inputs", IGNORED, osnArgs.mergeInputs, "not using the merge action");
 
-void CliProcessor::validateArgs()
-{
-    if (osnArgs.action == Action::HELP || displayHelp) {
+    if(osnArgs.action == Action::SERVE) {
+        // Input, model, and output are specified for every job
+        checkArgument("socket", REQUIRED, osnArgs.socketPath, "using the serve action");
+        DG_CHECK(osnArgs.maxModels > 0, "Argument --max-models must be at least 1");
+        DG_CHECK(osnArgs.maxQueuedJobs > 0, "Argument --max-queued-jobs must be at least 1");
+        DG_CHECK(osnArgs.maxClients > 0, "Argument --max-clients must be at least 1");
+        osnArgs.validate();
         return;
     }
 
-    DG_CHECK(osnArgs.action == Action::DETECT, "Try 'OpenSpaceNet --help' for more information.");
+    checkArgument("socket", IGNORED, osnArgs.socketPath, "not using the serve action");
+
+    bool isBatch = osnArgs.action == Action::BATCH;
+    if(isBatch) {
+        DG_CHECK(osnArgs.source == Source::UNKNOWN || osnArgs.source == Source::LOCAL,
+                 "The batch action only supports local images");
+        checkArgument("manifest", REQUIRED, osnArgs.manifestPath, "using the batch action");
+        checkArgument("image", IGNORED, osnArgs.image, "using the batch action");
+        osnArgs.source = Source::LOCAL;
+    } else {
+        checkArgument("manifest", IGNORED, osnArgs.manifestPath, "not using the batch action");
+    }
 
     //
     // Validate action args.
@@ -568,29 +703,35 @@ void CliProcessor::validateArgs()
     checkArgument("credentials", credentialsUse, osnArgs.credentials, sourceDescription);
     checkArgument("map-id", mapIdUse, mapIdSet, sourceDescription);
     checkArgument("zoom", zoomUse, zoomSet, sourceDescription);
-    checkArgument("bbox", bboxUse, (bool) osnArgs.bbox, sourceDescription);
+    checkArgument("bbox", isBatch ? IGNORED : bboxUse, (bool) osnArgs.bbox,
+                  isBatch ? "using the batch action" : sourceDescription);
     checkArgument("max-connections", maxConnectionsUse, maxConnectionsSet, sourceDescription);
     checkArgument("url", urlUse, osnArgs.url, sourceDescription);
     checkArgument("use-tiles", useTilesUse, osnArgs.useTiles, sourceDescription);
+    checkArgument("tile-cache", maxConnectionsUse, osnArgs.tileCacheDir, sourceDescription);
+    checkArgument("adaptive-connections", osnArgs.tileCacheDir.empty() ? maxConnectionsUse : IGNORED,
+                  osnArgs.adaptiveConnections, osnArgs.tileCacheDir.empty() ? sourceDescription : "using --tile-cache");
 
     //
     // Validate model and detection
     //
-    checkArgument("model", REQUIRED, osnArgs.modelPath);
+    checkArgument("model", REQUIRED, osnArgs.modelPaths);
 
-    DG_CHECK(osnArgs.includeLabels.empty() || osnArgs.excludeLabels.empty(),
-             "Arguments --include-labels and --exclude-labels may not be specified at the same time");
-
-    if(windowSizeUse > MAY_USE_ONE || windowStepUse > MAY_USE_ONE) {
-        DG_CHECK(osnArgs.windowSize.size() < 2 || osnArgs.windowStep.size() < 2 ||
-                 osnArgs.windowSize.size() == osnArgs.windowStep.size(),
-                 "Arguments --window-size and --window-step must match in length");
+    // The checks shared with the jobs of the serve action
+    osnArgs.validate();
+    if(!osnArgs.cascade) {
+        checkArgument("cascade-model", IGNORED, osnArgs.cascadeModelPath, "not using --cascade");
     }
 
     //
     // Validate output
     //
-    checkArgument("output", REQUIRED, osnArgs.outputPath);
+    if(isBatch) {
+        checkArgument("output", IGNORED, osnArgs.outputPath, "using the batch action");
+    } else {
+        checkArgument("output", REQUIRED, osnArgs.outputPath);
+    }
+
     if(osnArgs.outputFormat  == "shp") {
         checkArgument("output-layer", IGNORED, osnArgs.layerName, "the output format is a shapefile");
         osnArgs.layerName = path(osnArgs.outputPath).stem().filename().string();
@@ -598,6 +739,10 @@ void CliProcessor::validateArgs()
         osnArgs.layerName = "osndetects";
     }
 
+    if(isBatch) {
+        readBatchManifest();
+    }
+
     //
     // Validate filtering
     //
@@ -669,11 +814,11 @@ void CliProcessor::readArgs(variables_map vm, bool splitArgs) {
     readProcessingArgs(vm, splitArgs);
     readOutputArgs(vm, splitArgs);
     readFeatureDetectionArgs(vm, splitArgs);
+    readCascadeArgs(vm, splitArgs);
     readLoggingArgs(vm, splitArgs);
-
-    if(!osnArgs.modelPath.empty()) {
-        readModelPackage();
-    }
+    readVariable("manifest", vm, osnArgs.manifestPath);
+    readServerArgs(vm, splitArgs);
+    readVariable("inputs", vm, osnArgs.mergeInputs, splitArgs);
 
     readSegmentationArgs(vm, splitArgs);
 }
@@ -687,6 +832,16 @@ void CliProcessor::readWebServiceArgs(variables_map vm, bool splitArgs)
     osnArgs.useTiles = vm.find("use-tiles") != vm.end();
     zoomSet |= readVariable("zoom", vm, osnArgs.zoom);
     maxConnectionsSet |= readVariable("max-connections", vm, osnArgs.maxConnections);
+    osnArgs.adaptiveConnections |= vm.find("adaptive-connections") != vm.end();
+
+    readVariable("tile-cache", vm, osnArgs.tileCacheDir);
+    string sizeString(DEFAULT_TILE_CACHE_SIZE);
+    readVariable("tile-cache-size", vm, sizeString);
+    try {
+        osnArgs.tileCacheSize = memory::stringToRam(sizeString);
+    } catch(...) {
+        DG_ERROR_THROW("Argument --tile-cache-size is invalid");
+    }
 }
 
 
@@ -724,7 +879,23 @@ void CliProcessor::readProcessingArgs(variables_map vm, bool splitArgs)
 {
     osnArgs.useCpu = vm.find("cpu") != end(vm);
     readVariable("max-utilization", vm, osnArgs.maxUtilization);
-    readVariable("model", vm, osnArgs.modelPath);
+    readVariable("inference-workers", vm, osnArgs.inferenceWorkers);
+    if(readVariable("batch-size", vm, osnArgs.batchSize)) {
+        DG_CHECK(osnArgs.batchSize > 0, "Argument --batch-size must be at least 1");
+    }
+    string superTile;
+    if(readVariable("super-tile", vm, superTile)) {
+        if(superTile == "auto") {
+            osnArgs.autoSuperTile = true;
+        } else {
+            try {
+                osnArgs.superTileSize = lexical_cast<int>(superTile);
+            } catch(bad_lexical_cast&) {
+                DG_ERROR_THROW("Argument --super-tile must be a size or auto: %s", superTile.c_str());
+            }
+        }
+    }
+    readVariable("model", vm, osnArgs.modelPaths, splitArgs);
 
     readVariable("window-size", vm, osnArgs.windowSize, splitArgs);
     readVariable("window-step", vm, osnArgs.windowStep, splitArgs);
@@ -736,6 +907,39 @@ void CliProcessor::readProcessingArgs(variables_map vm, bool splitArgs)
         parseFilterArgs(vm["region"].as<std::vector<std::string>>());
     }
 
+    osnArgs.screen = vm.find("screen") != end(vm);
+    osnArgs.screen |= readVariable("screen-max-invalid", vm, osnArgs.screenMaxInvalid);
+    osnArgs.screen |= readVariable("screen-min-stddev", vm, osnArgs.screenMinStdDev);
+
+    string shard;
+    if(readVariable("shard", vm, shard)) {
+        std::vector<string> parts;
+        boost::split(parts, shard, boost::is_any_of("/"));
+        DG_CHECK(parts.size() == 2, "Invalid --shard parameter: %s", shard.c_str());
+        try {
+            osnArgs.shardIndex = lexical_cast<int>(parts[0]);
+            osnArgs.shardCount = lexical_cast<int>(parts[1]);
+        } catch(bad_lexical_cast&) {
+            DG_ERROR_THROW("Invalid --shard parameter: %s", shard.c_str());
+        }
+        DG_CHECK(osnArgs.shardCount > 0 && osnArgs.shardIndex >= 0 && osnArgs.shardIndex < osnArgs.shardCount,
+                 "Invalid --shard parameter: %s, INDEX must be between 0 and COUNT - 1", shard.c_str());
+    }
+
+    if(vm.find("checkpoint") != end(vm)) {
+        std::vector<int> args;
+        readVariable("checkpoint", vm, args);
+        osnArgs.checkpointStrips = args.empty() ? DEFAULT_CHECKPOINT_STRIPS : args[0];
+        DG_CHECK(osnArgs.checkpointStrips > 0, "Argument --checkpoint must be at least 1");
+    }
+
+    if(vm.find("resume") != end(vm)) {
+        osnArgs.resume = true;
+        if(!osnArgs.checkpointStrips) {
+            osnArgs.checkpointStrips = DEFAULT_CHECKPOINT_STRIPS;
+        }
+    }
+
     string sizeString("25%");
     readVariable("max-cache-size", vm, sizeString);
     try {
@@ -759,11 +963,24 @@ void CliProcessor::readFeatureDetectionArgs(variables_map vm, bool /* splitArgs
     }
 }
 
-void CliProcessor::readSegmentationArgs(boost::program_options::variables_map vm, bool /* splitArgs */)
+void CliProcessor::readCascadeArgs(variables_map vm, bool /* splitArgs */)
 {
-    bool isSegmentation = (osnArgs.modelPackage && osnArgs.modelPackage->metadata().category() == "segmentation");
-    static const char* CAUSE = "input model is not a segmentation model.";
+    if(vm.find("cascade") != end(vm)) {
+        osnArgs.cascade = true;
+        std::vector<int> args;
+        readVariable("cascade", vm, args);
+        if(args.size()) {
+            osnArgs.cascadeStep = args[0];
+        }
+    }
+
+    readVariable("cascade-confidence", vm, osnArgs.cascadeConfidence);
+    readVariable("cascade-model", vm, osnArgs.cascadeModelPath);
+}
 
+void CliProcessor::readSegmentationArgs(boost::program_options::variables_map vm, bool /* splitArgs */)
+{
+    // Whether these apply is checked once the models are loaded
     string method;
     if(readVariable("r2p-method", vm, method)) {
         if(iequals(method, "none")) {
@@ -777,23 +994,25 @@ void CliProcessor::readSegmentationArgs(boost::program_options::variables_map vm
         } else {
             DG_ERROR_THROW("Invalid --r2p-method parameter: '%s'", method.c_str());
         }
-
-        if(!isSegmentation) {
-            checkArgument("r2p-method", IGNORED, true, CAUSE);
-        }
     }
 
-    if(readVariable("r2p-accuracy", vm, osnArgs.epsilon) && !isSegmentation) {
-        checkArgument("r2p-accuracy", IGNORED, true, CAUSE);
-    }
+    readVariable("r2p-accuracy", vm, osnArgs.epsilon);
+    readVariable("r2p-min-area", vm, osnArgs.minArea);
+}
 
-    if(readVariable("r2p-min-area", vm, osnArgs.minArea) && !isSegmentation) {
-        checkArgument("r2p-min-area", IGNORED, true, CAUSE);
-    }
+void CliProcessor::readServerArgs(variables_map vm, bool /* splitArgs */)
+{
+    readVariable("socket", vm, osnArgs.socketPath);
+    readVariable("max-models", vm, osnArgs.maxModels);
+    readVariable("max-queued-jobs", vm, osnArgs.maxQueuedJobs);
+    readVariable("max-clients", vm, osnArgs.maxClients);
 }
 
 void CliProcessor::readLoggingArgs(variables_map vm, bool splitArgs)
 {
+    readVariable("metrics-out", vm, osnArgs.metricsPath);
+    readVariable("trace-out", vm, osnArgs.tracePath);
+
     if(vm.find("quiet") != end(vm)) {
         consoleLogLevel = level_t::fatal;
     } if(vm.find("trace") != end(vm)) {
@@ -865,6 +1084,59 @@ void CliProcessor::parseFilterArgs(const std::vector<string>& filterList)
     }
 }
 
+void CliProcessor::readBatchManifest()
+{
+    std::ifstream ifs(osnArgs.manifestPath);
+    DG_CHECK(ifs.is_open(), "Unable to open batch manifest %s", osnArgs.manifestPath.c_str());
+
+    using so_tokenizer = tokenizer<escaped_list_separator<char> >;
+
+    string line;
+    for(int lineNumber = 1; std::getline(ifs, line); ++lineNumber) {
+        boost::trim(line);
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::vector<string> tokens;
+        so_tokenizer tok(line, escaped_list_separator<char>('\\', ' ', '\"'));
+        for(const auto& t : tok) {
+            if(!t.empty()) {
+                tokens.push_back(t);
+            }
+        }
+
+        DG_CHECK(tokens.size() == 2 || tokens.size() == 6,
+                 "Invalid batch manifest entry on line %d: expected IMAGE OUTPUT [WEST SOUTH EAST NORTH]", lineNumber);
+
+        BatchItem item;
+        item.image = tokens[0];
+        item.outputPath = tokens[1];
+
+        if(tokens.size() == 6) {
+            try {
+                auto west = lexical_cast<double>(tokens[2]);
+                auto south = lexical_cast<double>(tokens[3]);
+                auto east = lexical_cast<double>(tokens[4]);
+                auto north = lexical_cast<double>(tokens[5]);
+                item.bbox = make_unique<cv::Rect2d>(cv::Point2d(west, south), cv::Point2d(east, north));
+            } catch(bad_lexical_cast&) {
+                DG_ERROR_THROW("Invalid bounding box in batch manifest on line %d", lineNumber);
+            }
+        }
+
+        if(osnArgs.outputFormat == "shp") {
+            item.layerName = path(item.outputPath).stem().filename().string();
+        } else {
+            item.layerName = osnArgs.layerName;
+        }
+
+        osnArgs.batchItems.push_back(move(item));
+    }
+
+    DG_CHECK(!osnArgs.batchItems.empty(), "Batch manifest %s does not contain any images", osnArgs.manifestPath.c_str());
+}
+
 bool CliProcessor::showHelp()
 {
     return displayHelp;
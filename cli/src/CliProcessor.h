@@ -20,6 +20,8 @@
 
 #include <OpenSpaceNetArgs.h>
 #include <OpenSpaceNet.h>
+#include <OpenSpaceNetServer.h>
+#include <ShardMerger.h>
 #include <boost/program_options.hpp>
 
 namespace dg { namespace osn {
@@ -55,11 +57,13 @@ private:
     void readOutputArgs(boost::program_options::variables_map vm, bool splitArgs=false);
     void readProcessingArgs(boost::program_options::variables_map vm, bool splitArgs=false);
     void readFeatureDetectionArgs(boost::program_options::variables_map vm, bool splitArgs=false);
+    void readCascadeArgs(boost::program_options::variables_map vm, bool splitArgs=false);
     void readSegmentationArgs(boost::program_options::variables_map vm, bool splitArgs=false);
+    void readServerArgs(boost::program_options::variables_map vm, bool splitArgs=false);
     void readLoggingArgs(boost::program_options::variables_map vm, bool splitArgs=false);
     void parseFilterArgs(const std::vector<std::string>& filterList);
+    void readBatchManifest();
 
-    void readModelPackage();
     void validateArgs();
 
     boost::program_options::options_description localOptions_;
@@ -69,6 +73,10 @@ private:
     boost::program_options::options_description detectOptions_;
     boost::program_options::options_description segmentationOptions_;
     boost::program_options::options_description filterOptions_;
+    boost::program_options::options_description cascadeOptions_;
+    boost::program_options::options_description batchOptions_;
+    boost::program_options::options_description serverOptions_;
+    boost::program_options::options_description mergeOptions_;
     boost::program_options::options_description loggingOptions_;
     boost::program_options::options_description generalOptions_;
 
@@ -0,0 +1,59 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef OPENSPACENET_CHIPSCREEN_H
+#define OPENSPACENET_CHIPSCREEN_H
+
+#include <memory>
+#include <opencv2/core/types.hpp>
+#include <string>
+#include <vector>
+
+class GDALDataset;
+
+namespace dg { namespace osn {
+
+//
+// Finds the parts of a local image that are not worth running a model on: cells that are mostly
+// no-data or transparent, and cells that are uniform, such as clouds or water. The statistics are
+// computed from a decimated read of the image, which uses the image overviews if it has any,
+// before any windows are processed.
+//
+class ChipScreen
+{
+public:
+    ChipScreen(const std::string& path, float maxInvalidFraction, float minStdDev);
+    ~ChipScreen();
+
+    // Returns the cells of the area that pass the screening, in image pixel coordinates
+    std::vector<cv::Rect> screen(const cv::Rect& area, cv::Size cellSize);
+    size_t rejectedCells() const;
+
+private:
+    struct DatasetDeleter
+    {
+        void operator()(GDALDataset* dataset) const;
+    };
+
+    std::unique_ptr<GDALDataset, DatasetDeleter> dataset_;
+    float maxInvalidFraction_;
+    float minStdDev_;
+    size_t rejectedCells_ = 0;
+};
+
+} } // namespace dg { namespace osn {
+
+#endif //OPENSPACENET_CHIPSCREEN_H
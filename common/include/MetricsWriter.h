@@ -0,0 +1,73 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef OPENSPACENET_METRICSWRITER_H
+#define OPENSPACENET_METRICSWRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace dg { namespace osn {
+
+//
+// Periodically writes processing metrics to a file, as JSON, or in the Prometheus textfile format
+// if the file name ends with ".prom". The file is replaced atomically, so it can be read at any
+// time. Counters accumulate over all runs of the processing graph, gauges hold their last value.
+//
+class MetricsWriter
+{
+public:
+    MetricsWriter(const std::string& path, std::chrono::seconds interval);
+    ~MetricsWriter();
+
+    void add(const std::string& name, const std::string& model, double delta);
+    void set(const std::string& name, const std::string& model, double value);
+
+private:
+    struct Metric
+    {
+        bool counter;
+        double value = 0;
+        double lastValue = 0;
+    };
+
+    typedef std::pair<std::string, std::string> MetricKey;
+
+    void run();
+    void write();
+    std::string formatJson(double seconds);
+    std::string formatPrometheus();
+
+    std::string path_;
+    std::chrono::seconds interval_;
+    bool prometheus_;
+    std::chrono::steady_clock::time_point startTime_;
+    std::chrono::steady_clock::time_point lastWrite_;
+
+    std::mutex mutex_;
+    std::condition_variable stopped_;
+    bool stop_ = false;
+    std::map<MetricKey, Metric> metrics_;
+    std::thread thread_;
+};
+
+} } // namespace dg { namespace osn {
+
+#endif //OPENSPACENET_METRICSWRITER_H
@@ -0,0 +1,54 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef OPENSPACENET_MODELCACHE_H
+#define OPENSPACENET_MODELCACHE_H
+
+#include <classification/Model.h>
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace dg { namespace osn {
+
+//
+// Least recently used cache of loaded models, keyed by the model package path.
+//
+class ModelCache
+{
+public:
+    ModelCache(size_t capacity, bool useGpu, float maxUtilization);
+
+    deepcore::classification::Model::Ptr get(const std::string& path);
+    void put(const std::string& path, deepcore::classification::Model::Ptr model);
+
+private:
+    typedef std::list<std::pair<std::string, deepcore::classification::Model::Ptr>> ModelList;
+
+    void trim();
+
+    size_t capacity_;
+    bool useGpu_;
+    float maxUtilization_;
+
+    std::mutex mutex_;
+    ModelList models_;
+    std::map<std::string, ModelList::iterator> index_;
+};
+
+} } // namespace dg { namespace osn {
+
+#endif //OPENSPACENET_MODELCACHE_H
@@ -19,16 +19,24 @@
 #ifndef OPENSPACENET_OPENSPACENET_H
 #define OPENSPACENET_OPENSPACENET_H
 
+#include "MetricsWriter.h"
 #include "OpenSpaceNetArgs.h"
+#include "TraceWriter.h"
 #include <classification/Model.h>
 #include <classification/node/Detector.h>
 #include <geometry/SpatialReference.h>
 #include <geometry/node/LabelFilter.h>
 #include <geometry/node/SubsetRegionFilter.h>
+#include <imagery/GdalImage.h>
 #include <imagery/node/GeoBlockSource.h>
 #include <imagery/node/SlidingWindow.h>
 #include <network/HttpCleanup.h>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
 #include <opencv2/core/types.hpp>
+#include <set>
 #include <vector/node/FileFeatureSink.h>
 #include <vector/node/PredictionToFeature.h>
 #include <vector/node/WfsFeatureFieldExtractor.h>
@@ -40,41 +48,173 @@ namespace dg { namespace osn {
 class OpenSpaceNet
 {
 public:
+    //
+    // Called with the name and the new value of a processing metric: "windows" is the total number
+    // of windows, "read" is the number of windows read, "processed" is the number of windows
+    // processed by the model, "features" is the number of features written, "screened" is the
+    // number of image cells skipped by chip screening, and "connections" is the number of
+    // concurrent map service downloads when it is adapted.
+    //
+    typedef std::function<void(const std::string&, int64_t)> ProgressCallback;
+
     OpenSpaceNet(OpenSpaceNetArgs&& args);
     void process();
     void setProgressDisplay(boost::shared_ptr<deepcore::ProgressDisplay> display);
+    void setProgressCallback(ProgressCallback callback);
+    void setModels(std::vector<deepcore::classification::Model::Ptr> models);
 
 private:
-    deepcore::imagery::node::GeoBlockSource::Ptr initLocalImage();
-    deepcore::imagery::node::GeoBlockSource::Ptr initMapServiceImage();
-    deepcore::geometry::node::SubsetRegionFilter::Ptr initSubsetRegionFilter();
-    deepcore::classification::node::Detector::Ptr initDetector();
+    struct DetectionModel
+    {
+        deepcore::classification::Model::Ptr model;
+        std::vector<deepcore::classification::Model::Ptr> replicas;
+        std::unique_ptr<deepcore::classification::ModelMetadata> metadata;
+        std::string name;
+        cv::Size primaryWindowSize;
+        cv::Point primaryWindowStep;
+        float aspectRatio;
+
+        // Cascade models only run the primary window size, with the coarse cascade step
+        bool cascade = false;
+
+        bool isSegmentation() const;
+    };
+
+    // The part of the processing graph that belongs to one model
+    struct Branch
+    {
+        deepcore::imagery::node::SlidingWindow::Ptr slidingWindow;
+        deepcore::classification::node::Detector::Ptr detector;
+        deepcore::vector::node::FileFeatureSink::Ptr featureSink;
+    };
+
+    // Grid of window origins along the side of the AOI that is split into strips
+    struct StripGrid
+    {
+        bool splitRows;
+        int length;
+        int cellSize = 1;
+        int cells;
+        std::vector<std::pair<int, int>> windows;
+    };
+
+    // Polygons of a region filter file, in image pixel coordinates
+    struct FilterPolygons
+    {
+        std::vector<deepcore::geometry::Polygon> polygons;
+        cv::Rect bounds;
+    };
+
+    // Settings of one run of the processing graph
+    struct Pass
+    {
+        cv::Rect aoi;
+
+        // If set, only the windows with their origin in this area are processed, so that a window
+        // is processed by only one of the strips that contain it
+        cv::Rect origins;
+
+        deepcore::vector::VectorOpenMode openMode;
+        size_t replica = 0;
+
+        // If set, these models are run instead of the detection models
+        const std::vector<DetectionModel>* models = nullptr;
+
+        // If set, features are written to files in this directory instead of the output, see passFormat()
+        std::string outputDir;
+
+        // If set, the pass starts and stops the progress display, otherwise the caller does
+        bool ownDisplay = true;
+    };
+
+    void processBatch();
+    void detect();
+    void screenChips(const cv::Rect& aoi);
+    void runCascade(const cv::Rect& aoi);
+    static std::vector<cv::Rect2d> readEnvelopes(const std::string& path);
+    void detectParallel(const StripGrid& grid, int beginCell, int endCell, deepcore::vector::VectorOpenMode openMode);
+    void mergePasses(const std::vector<std::string>& passDirs, deepcore::vector::VectorOpenMode openMode);
+
+    // Measurements of one run of the processing graph
+    struct PassStats
+    {
+        double seconds = 0;
+        int64_t windowsRead = 0;
+        double meanBacklog = 0;
+    };
+
+    void detectRegions(Pass pass);
+    void detectParts(Pass pass, const std::vector<std::pair<cv::Rect, cv::Rect>>& parts, const std::string& partName);
+    void detectSuperTiles(Pass pass, int superTileSize);
+    PassStats detectArea(Pass pass);
+    bool adaptiveDownloads() const;
+    void adaptConnections(const PassStats& stats);
+    Branch initBranch(const DetectionModel& model, deepcore::imagery::node::GeoBlockSource::Ptr blockSource,
+                      const Pass& pass);
+
+    void initImage();
+    void initLocalImage(std::unique_ptr<deepcore::imagery::GdalImage> image, const std::string& path);
+    void initMapServiceImage();
+    void initRegionFilter();
+    void readRegionFiles();
+    FilterPolygons readFilterPolygons(const std::string& path) const;
+    void initModels();
+    void initCascadeModels();
+    deepcore::classification::node::Detector::Ptr initDetector(const DetectionModel& model, size_t replica);
     void initSegmentation(deepcore::classification::Model::Ptr model);
-    deepcore::imagery::node::SlidingWindow::Ptr initSlidingWindow();
+    deepcore::imagery::node::SlidingWindow::Ptr initSlidingWindow(const DetectionModel& model, const cv::Rect& aoi);
     deepcore::geometry::node::LabelFilter::Ptr initLabelFilter(bool isSegmentation);
-    deepcore::vector::node::PredictionToFeature::Ptr initPredictionToFeature();
+    deepcore::vector::node::PredictionToFeature::Ptr initPredictionToFeature(const Pass& pass);
     deepcore::vector::node::WfsFeatureFieldExtractor::Ptr initWfs();
-    deepcore::vector::node::FileFeatureSink::Ptr initFeatureSink();
+    deepcore::vector::node::FileFeatureSink::Ptr initFeatureSink(const DetectionModel& model, const Pass& pass);
 
-    void printModel();
+    void printModel(const DetectionModel& model);
     void skipLine() const;
-    deepcore::imagery::SizeSteps calcWindows() const;
+    deepcore::imagery::SizeSteps calcWindows(const DetectionModel& model) const;
+    StripGrid calcStripGrid() const;
+    StripGrid calcStripGrid(bool splitRows) const;
+    cv::Rect calcStrip(const StripGrid& grid, int beginCell, int endCell) const;
+    cv::Rect calcStripOrigins(const StripGrid& grid, int beginCell, int endCell) const;
+    bool clipToRegions(cv::Rect& aoi) const;
+    int calcSuperTileSize() const;
+    int64_t countBlocks(const cv::Rect& area) const;
+    std::string journalPath() const;
+    std::ofstream openJournal(int strips, std::set<int>& done) const;
+    void outputFor(const DetectionModel& model, std::string& outputPath, std::string& layerName) const;
 
     OpenSpaceNetArgs args_;
     std::shared_ptr<deepcore::network::HttpCleanup> cleanup_;
     boost::shared_ptr<deepcore::ProgressDisplay> pd_;
+    ProgressCallback progressCallback_;
+
+    // Progress values summed over all passes of the current detection, so that the progress does
+    // not start over with every pass
+    std::mutex progressMutex_;
+    std::map<std::string, int64_t> progressTotals_;
+    std::unique_ptr<MetricsWriter> metrics_;
+    std::unique_ptr<TraceWriter> trace_;
+    std::function<deepcore::imagery::node::GeoBlockSource::Ptr()> createBlockSource_;
+    int connections_ = 0;
+    int lastConnections_ = 0;
+    double lastReadRate_ = 0;
 
     cv::Size imageSize_;
+    cv::Size blockSize_;
+    int pixelBytes_ = 0;
     cv::Rect bbox_;
     deepcore::geometry::SpatialReference imageSr_;
     deepcore::geometry::SpatialReference sr_;
     std::unique_ptr<deepcore::geometry::Transformation> pixelToProj_;
     std::unique_ptr<deepcore::geometry::Transformation> pixelToLL_;
 
-    std::unique_ptr<deepcore::classification::ModelMetadata> metadata_;
-    cv::Size primaryWindowSize_;
-    cv::Point primaryWindowStep_;
-    float modelAspectRatio_;
+    std::vector<deepcore::classification::Model::Ptr> presetModels_;
+    std::vector<DetectionModel> models_;
+    std::vector<DetectionModel> cascadeModels_;
+    std::map<std::string, std::shared_future<FilterPolygons>> filterFiles_;
+    deepcore::geometry::RegionFilter::Ptr regionFilter_;
+    std::unique_ptr<cv::Rect> regionBounds_;
+    deepcore::geometry::RegionFilter::Ptr screenFilter_;
+    deepcore::geometry::RegionFilter::Ptr cascadeFilter_;
     bool haveAlpha_ = false;
 };
 
@@ -19,12 +19,13 @@
 #define OPENSPACENET_OPENSPACENETARGS_H
 
 #include <imagery/RasterToPolygonDP.h>
-#include <classification/ModelPackage.h>
 #include <vector/Feature.h>
 
 #define OSN_LOG(sev) DG_LOG(OpenSpaceNet, sev)
 #define MAPSAPI_MAPID  "digitalglobe.nal0g75k"
 #define WFS_TYPENAME "DigitalGlobe:FinishedFeature"
+#define DGCS_HOST "services.digitalglobe.com"
+#define EVWHS_HOST "evwhs.digitalglobe.com"
 
 
 namespace dg { namespace osn {
@@ -43,7 +44,18 @@ enum class Action
 {
     UNKNOWN,
     HELP,
-    DETECT
+    DETECT,
+    BATCH,
+    SERVE,
+    MERGE
+};
+
+struct BatchItem
+{
+    std::string image;
+    std::unique_ptr<cv::Rect2d> bbox;
+    std::string outputPath;
+    std::string layerName;
 };
 
 struct OpenSpaceNetArgs
@@ -60,9 +72,15 @@ struct OpenSpaceNetArgs
     std::string credentials;
     int zoom = 18;
     int maxConnections = 10;
+    bool adaptiveConnections = false;
+
+    // Number of strips the area of interest is processed in when the connections are adapted
+    int adaptiveStrips = 16;
     std::string mapId = MAPSAPI_MAPID;
     std::string url;
     bool useTiles=false;
+    std::string tileCacheDir;
+    size_t tileCacheSize = 0ULL;
 
 
     // Output options
@@ -78,14 +96,21 @@ struct OpenSpaceNetArgs
     std::vector<std::string> extraFields;
 
     // Processing options
-    std::string modelPath;
-    std::unique_ptr<deepcore::classification::ModelPackage> modelPackage;
+    std::vector<std::string> modelPaths;
     bool useCpu = false;
     float maxUtilization = 95;
     std::vector<int> windowSize;
     std::vector<int> windowStep;
     std::unique_ptr<int> resampledSize;
     size_t maxCacheSize = 0ULL;
+    int shardIndex = 0;
+    int shardCount = 1;
+    int checkpointStrips = 0;
+    bool resume = false;
+    int inferenceWorkers = 1;
+    int batchSize = 0;
+    int superTileSize = 0;
+    bool autoSuperTile = false;
 
     // Feature detection options
     float confidence = 95;
@@ -95,13 +120,45 @@ struct OpenSpaceNetArgs
     std::vector<std::string> excludeLabels;
     std::vector<std::pair<std::string, std::vector<std::string>>> filterDefinition;
 
+    // Chip screening options
+    bool screen = false;
+    float screenMaxInvalid = 100;
+    float screenMinStdDev = 0;
+
+    // Cascade options
+    bool cascade = false;
+    int cascadeStep = 0;
+    float cascadeConfidence = 50;
+    std::string cascadeModelPath;
+
     // Segmentation options
     deepcore::imagery::RasterToPolygonDP::Method method = deepcore::imagery::RasterToPolygonDP::SIMPLE;
     double epsilon = 3.0;
     double minArea = 0.0;
 
+    // Batch options
+    std::string manifestPath;
+    std::vector<BatchItem> batchItems;
+
+    // Server options
+    std::string socketPath;
+    int maxModels = 2;
+    int maxQueuedJobs = 16;
+    int maxClients = 16;
+
+    // Merge options
+    std::vector<std::string> mergeInputs;
+
     // Logging options
     bool quiet = false;
+    std::string metricsPath;
+    std::string tracePath;
+
+    // Returns a copy of all options
+    OpenSpaceNetArgs copy() const;
+
+    // Checks the processing options that may not be combined, throws if they are invalid
+    void validate() const;
 };
 
 } } // namespace dg { namespace osn {
@@ -0,0 +1,77 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef OPENSPACENET_OPENSPACENETSERVER_H
+#define OPENSPACENET_OPENSPACENETSERVER_H
+
+#include "ModelCache.h"
+#include "OpenSpaceNetArgs.h"
+#include <condition_variable>
+#include <deque>
+#include <json/json.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace dg { namespace osn {
+
+//
+// Runs detection jobs submitted over a Unix domain socket. Each job is a single line of JSON, the
+// server replies with a stream of JSON status lines for that job. Jobs are executed one at a time
+// in submission order, and the loaded models are kept in a LRU cache between jobs. The server runs
+// until it receives SIGINT or SIGTERM.
+//
+class OpenSpaceNetServer
+{
+public:
+    OpenSpaceNetServer(OpenSpaceNetArgs&& defaults);
+    ~OpenSpaceNetServer();
+
+    void run();
+
+private:
+    struct Job;
+
+    void acceptConnection();
+    void reapConnections();
+    void serveConnection(int fd);
+    void processJobs();
+    void processJob(Job& job);
+    void stop();
+    OpenSpaceNetArgs jobArgs(const Json::Value& request, int jobId) const;
+
+    OpenSpaceNetArgs defaults_;
+    ModelCache models_;
+    int listenFd_ = -1;
+    bool stop_ = false;
+    std::thread worker_;
+
+    std::mutex connectionMutex_;
+    std::set<int> connectionFds_;
+    std::map<std::thread::id, std::thread> connectionThreads_;
+    std::vector<std::thread::id> finishedThreads_;
+
+    std::mutex queueMutex_;
+    std::condition_variable queueChanged_;
+    std::deque<std::shared_ptr<Job>> queue_;
+    int nextJobId_ = 1;
+};
+
+} } // namespace dg { namespace osn {
+
+#endif //OPENSPACENET_OPENSPACENETSERVER_H
@@ -0,0 +1,79 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef OPENSPACENET_SHARDMERGER_H
+#define OPENSPACENET_SHARDMERGER_H
+
+#include "OpenSpaceNetArgs.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+class GDALDataset;
+class OGRFeature;
+
+namespace dg { namespace osn {
+
+//
+// Combines the outputs of sharded runs into a single feature set. Features that were
+// detected in the overlap between two shards are written only once.
+//
+class ShardMerger
+{
+public:
+    // If suppressAll is set, the non-maximum suppression compares all features, not only the
+    // features of different inputs, for inputs that were written without it
+    ShardMerger(OpenSpaceNetArgs&& args, bool suppressAll = false);
+    void process();
+
+    // Number of features written to the output by process()
+    size_t featuresWritten() const;
+
+private:
+    struct DatasetDeleter
+    {
+        void operator()(GDALDataset* dataset) const;
+    };
+
+    struct FeatureDeleter
+    {
+        void operator()(OGRFeature* feature) const;
+    };
+
+    struct MergedFeature
+    {
+        std::unique_ptr<OGRFeature, FeatureDeleter> feature;
+        std::string category;
+        double score;
+        size_t input;
+    };
+
+    void readInputs();
+    void removeDuplicates();
+    void suppressSeams();
+    void writeOutput();
+
+    OpenSpaceNetArgs args_;
+    bool suppressAll_;
+    std::vector<std::unique_ptr<GDALDataset, DatasetDeleter>> inputs_;
+    std::vector<MergedFeature> features_;
+    std::vector<bool> removed_;
+    size_t written_ = 0;
+};
+
+} } // namespace dg { namespace osn {
+
+#endif //OPENSPACENET_SHARDMERGER_H
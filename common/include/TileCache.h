@@ -0,0 +1,58 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef OPENSPACENET_TILECACHE_H
+#define OPENSPACENET_TILECACHE_H
+
+#include "OpenSpaceNetArgs.h"
+#include <opencv2/core/types.hpp>
+#include <string>
+#include <vector>
+
+namespace dg { namespace osn {
+
+//
+// Persistent on-disk cache of map service tiles. Every tile is stored in the cache directory in
+// its original encoding, under a path that names the service, layer, zoom level and tile
+// position, but not the token or credentials, so a tile is only downloaded once for any number of
+// runs over the same area, also after the token changes. The tiles of the bounding box that are
+// not cached yet are downloaded before processing starts, and the image is read from the cached
+// tiles through a GDAL virtual dataset. Tiles expire a week after they were downloaded, and when
+// the cache grows past its maximum size, the tiles that were downloaded first are removed.
+//
+class TileCache
+{
+public:
+    TileCache(const OpenSpaceNetArgs& args);
+
+    // Downloads the missing tiles and returns the GDAL dataset description of the cached tiles
+    std::string datasetDescription() const;
+
+private:
+    std::string tileUrl() const;
+    std::string tileJsonUrl() const;
+    std::string serviceDir() const;
+    std::string tilePath(const cv::Point& tile) const;
+    void download(const std::vector<cv::Point>& tiles) const;
+    void trim(const std::vector<cv::Point>& keep) const;
+    std::string virtualDataset(const cv::Rect& tiles) const;
+
+    const OpenSpaceNetArgs& args_;
+};
+
+} } // namespace dg { namespace osn {
+
+#endif //OPENSPACENET_TILECACHE_H
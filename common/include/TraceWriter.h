@@ -0,0 +1,81 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#ifndef OPENSPACENET_TRACEWRITER_H
+#define OPENSPACENET_TRACEWRITER_H
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace dg { namespace osn {
+
+//
+// Writes a timeline of the processing in the Chrome trace event format, which can be opened in
+// Perfetto or chrome://tracing. Events are streamed to the file as they are recorded, each thread
+// gets its own track, named after the first event recorded on it.
+//
+class TraceWriter
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    explicit TraceWriter(const std::string& path);
+    ~TraceWriter();
+
+    // A span of work on the calling thread that started at startTime and ends now
+    void complete(const std::string& name, const std::string& category, TimePoint startTime);
+
+    // A number of work units that the calling thread finished now
+    void instant(const std::string& name, const std::string& category, int64_t count);
+
+    // The value of a counter track
+    void counter(const std::string& name, const std::string& series, double value);
+
+private:
+    int threadId(const std::string& name);
+    int64_t micros(TimePoint time) const;
+    void writeEvent(const std::string& event);
+
+    TimePoint startTime_;
+    std::mutex mutex_;
+    std::ofstream file_;
+    bool first_ = true;
+    std::map<std::thread::id, int> threadIds_;
+};
+
+//
+// Records the lifetime of the object as a span, if there is a trace writer
+//
+class TraceSpan
+{
+public:
+    TraceSpan(TraceWriter* writer, std::string name, std::string category = "osn");
+    ~TraceSpan();
+
+private:
+    TraceWriter* writer_;
+    std::string name_;
+    std::string category_;
+    TraceWriter::TimePoint startTime_;
+};
+
+} } // namespace dg { namespace osn {
+
+#endif //OPENSPACENET_TRACEWRITER_H
@@ -0,0 +1,184 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "ChipScreen.h"
+
+#include <algorithm>
+#include <cmath>
+#include <gdal_priv.h>
+#include <OpenSpaceNetArgs.h>
+#include <utility/Logging.h>
+
+namespace dg { namespace osn {
+
+using std::string;
+using std::vector;
+
+// Maximum number of samples read along each side of a cell
+static const int MAX_SAMPLES_PER_CELL = 16;
+
+void ChipScreen::DatasetDeleter::operator()(GDALDataset* dataset) const
+{
+    GDALClose(dataset);
+}
+
+ChipScreen::ChipScreen(const string& path, float maxInvalidFraction, float minStdDev) :
+    maxInvalidFraction_(maxInvalidFraction),
+    minStdDev_(minStdDev)
+{
+    GDALAllRegister();
+    dataset_.reset((GDALDataset*) GDALOpen(path.c_str(), GA_ReadOnly));
+    DG_CHECK(dataset_, "Unable to open %s", path.c_str());
+
+    if(dataset_->GetRasterCount() > 0 && !dataset_->GetRasterBand(1)->GetOverviewCount()) {
+        OSN_LOG(info) << "The image has no overviews, chip screening decodes every block of the area of interest";
+    }
+}
+
+ChipScreen::~ChipScreen() = default;
+
+vector<cv::Rect> ChipScreen::screen(const cv::Rect& area, cv::Size cellSize)
+{
+    vector<GDALRasterBand*> bands;
+    vector<int> hasNoData;
+    vector<double> noData;
+    GDALRasterBand* alphaBand = nullptr;
+    for(int i = 1; i <= dataset_->GetRasterCount(); ++i) {
+        auto band = dataset_->GetRasterBand(i);
+        if(band->GetColorInterpretation() == GCI_AlphaBand) {
+            alphaBand = band;
+        } else {
+            int has = FALSE;
+            noData.push_back(band->GetNoDataValue(&has));
+            hasNoData.push_back(has);
+            bands.push_back(band);
+        }
+    }
+
+    int cellsX = (area.width + cellSize.width - 1) / cellSize.width;
+    int cellsY = (area.height + cellSize.height - 1) / cellSize.height;
+    int samplesX = std::min(cellSize.width, MAX_SAMPLES_PER_CELL);
+    int samplesY = std::min(cellSize.height, MAX_SAMPLES_PER_CELL);
+
+    // Every row of cells is read at once, decimated to samplesX by samplesY samples per cell. GDAL
+    // serves a decimated read from the image overviews when there are any, otherwise it still
+    // decodes every block of the area. The buffer columns that belong to each cell are contiguous,
+    // so the statistics of a cell are computed with straight loops over the buffer that the
+    // compiler vectorizes.
+    int bufferWidth = cellsX * samplesX;
+    vector<int> cellBegin(cellsX + 1, bufferWidth);
+    for(int x = bufferWidth - 1; x >= 0; --x) {
+        auto cell = std::min(cellsX - 1, (int) ((int64_t) x * area.width / bufferWidth / cellSize.width));
+        cellBegin[cell] = x;
+    }
+    for(int cell = cellsX - 1; cell >= 0; --cell) {
+        cellBegin[cell] = std::min(cellBegin[cell], cellBegin[cell + 1]);
+    }
+
+    vector<vector<float>> data(bands.size(), vector<float>(bufferWidth * samplesY));
+    vector<float> alpha(bufferWidth * samplesY);
+    vector<float> valid(bufferWidth * samplesY);
+
+    vector<cv::Rect> cells;
+    rejectedCells_ = 0;
+    for(int cellY = 0; cellY < cellsY; ++cellY) {
+        int y = area.y + cellY * cellSize.height;
+        int height = std::min(cellSize.height, area.y + area.height - y);
+
+        std::fill(valid.begin(), valid.end(), 1.0f);
+        if(alphaBand) {
+            DG_CHECK(alphaBand->RasterIO(GF_Read, area.x, y, area.width, height, alpha.data(), bufferWidth, samplesY,
+                                         GDT_Float32, 0, 0) == CE_None, "Unable to read the alpha band");
+            for(size_t i = 0; i < alpha.size(); ++i) {
+                valid[i] *= alpha[i] > 0 ? 1.0f : 0.0f;
+            }
+        }
+
+        for(size_t b = 0; b < bands.size(); ++b) {
+            auto& values = data[b];
+            DG_CHECK(bands[b]->RasterIO(GF_Read, area.x, y, area.width, height, values.data(), bufferWidth, samplesY,
+                                        GDT_Float32, 0, 0) == CE_None, "Unable to read band %d", (int) b + 1);
+            if(hasNoData[b] && std::isnan(noData[b])) {
+                // NaN never compares equal to itself, so a NaN no-data value is tested for explicitly
+                for(size_t i = 0; i < values.size(); ++i) {
+                    valid[i] *= std::isnan(values[i]) ? 0.0f : 1.0f;
+                }
+            } else if(hasNoData[b]) {
+                auto value = (float) noData[b];
+                for(size_t i = 0; i < values.size(); ++i) {
+                    valid[i] *= values[i] != value ? 1.0f : 0.0f;
+                }
+            }
+        }
+
+        for(int cellX = 0; cellX < cellsX; ++cellX) {
+            int begin = cellBegin[cellX];
+            int end = cellBegin[cellX + 1];
+            if(begin == end) {
+                continue;
+            }
+
+            double samples = 0;
+            double validSamples = 0;
+            for(int row = 0; row < samplesY; ++row) {
+                const float* v = &valid[row * bufferWidth];
+                for(int i = begin; i < end; ++i) {
+                    validSamples += v[i];
+                }
+                samples += end - begin;
+            }
+
+            bool accept = validSamples > 0 && 1.0 - validSamples / samples <= maxInvalidFraction_;
+            if(accept && minStdDev_ > 0) {
+                double maxVariance = 0;
+                for(const auto& values : data) {
+                    double sum = 0;
+                    double sumSq = 0;
+                    for(int row = 0; row < samplesY; ++row) {
+                        const float* d = &values[row * bufferWidth];
+                        const float* v = &valid[row * bufferWidth];
+                        for(int i = begin; i < end; ++i) {
+                            double value = v[i] ? d[i] : 0.0;
+                            sum += value;
+                            sumSq += value * value;
+                        }
+                    }
+
+                    auto mean = sum / validSamples;
+                    maxVariance = std::max(maxVariance, sumSq / validSamples - mean * mean);
+                }
+
+                accept = std::sqrt(std::max(maxVariance, 0.0)) > minStdDev_;
+            }
+
+            int x = area.x + cellX * cellSize.width;
+            if(accept) {
+                cells.emplace_back(x, y, std::min(cellSize.width, area.x + area.width - x), height);
+            } else {
+                ++rejectedCells_;
+            }
+        }
+    }
+
+    return cells;
+}
+
+size_t ChipScreen::rejectedCells() const
+{
+    return rejectedCells_;
+}
+
+} } // namespace dg { namespace osn {
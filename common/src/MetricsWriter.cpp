@@ -0,0 +1,157 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "MetricsWriter.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iomanip>
+#include <json/json.h>
+#include <OpenSpaceNetArgs.h>
+#include <sstream>
+#include <utility/Logging.h>
+
+namespace dg { namespace osn {
+
+using std::chrono::duration;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+using std::string;
+
+MetricsWriter::MetricsWriter(const string& path, seconds interval) :
+    path_(path),
+    interval_(interval),
+    prometheus_(boost::ends_with(path, ".prom")),
+    startTime_(steady_clock::now()),
+    lastWrite_(startTime_)
+{
+    thread_ = std::thread(&MetricsWriter::run, this);
+}
+
+MetricsWriter::~MetricsWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    stopped_.notify_all();
+    thread_.join();
+}
+
+void MetricsWriter::add(const string& name, const string& model, double delta)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& metric = metrics_[MetricKey(name, model)];
+    metric.counter = true;
+    metric.value += delta;
+}
+
+void MetricsWriter::set(const string& name, const string& model, double value)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& metric = metrics_[MetricKey(name, model)];
+    metric.counter = false;
+    metric.value = value;
+}
+
+void MetricsWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool last = false;
+    while(!last) {
+        last = stopped_.wait_for(lock, interval_, [this] { return stop_; });
+
+        // The file is written with the lock released, so that the processing is never held up by it
+        auto now = steady_clock::now();
+        duration<double> sinceLast = now - lastWrite_;
+        auto content = prometheus_ ? formatPrometheus() : formatJson(sinceLast.count());
+        lastWrite_ = now;
+        lock.unlock();
+
+        try {
+            // The file is replaced atomically, readers never see a partial write
+            auto tempPath = path_ + ".tmp";
+            {
+                std::ofstream file(tempPath);
+                file << content;
+                DG_CHECK(file, "Unable to write %s", tempPath.c_str());
+            }
+            boost::filesystem::rename(tempPath, path_);
+        } catch(const std::exception& e) {
+            OSN_LOG(warning) << "Unable to write the metrics: " << e.what();
+        }
+
+        lock.lock();
+    }
+}
+
+string MetricsWriter::formatJson(double seconds)
+{
+    duration<double> elapsed = steady_clock::now() - startTime_;
+
+    Json::Value root;
+    root["elapsed_seconds"] = elapsed.count();
+    root["metrics"] = Json::Value(Json::arrayValue);
+    for(auto& entry : metrics_) {
+        auto& metric = entry.second;
+
+        Json::Value value;
+        value["name"] = entry.first.first;
+        if(!entry.first.second.empty()) {
+            value["model"] = entry.first.second;
+        }
+        value["type"] = metric.counter ? "counter" : "gauge";
+        value["value"] = metric.value;
+        if(metric.counter) {
+            // Throughput since the previous write
+            value["rate"] = seconds > 0 ? (metric.value - metric.lastValue) / seconds : 0.0;
+            metric.lastValue = metric.value;
+        }
+        root["metrics"].append(value);
+    }
+
+    Json::StreamWriterBuilder builder;
+    return Json::writeString(builder, root) + "\n";
+}
+
+string MetricsWriter::formatPrometheus()
+{
+    std::ostringstream out;
+    out << std::setprecision(15);
+    string lastName;
+    for(const auto& entry : metrics_) {
+        const auto& name = entry.first.first;
+        const auto& metric = entry.second;
+        if(name != lastName) {
+            out << "# TYPE " << name << (metric.counter ? " counter" : " gauge") << "\n";
+            lastName = name;
+        }
+
+        out << name;
+        if(!entry.first.second.empty()) {
+            out << "{model=\"" << entry.first.second << "\"}";
+        }
+        out << " " << metric.value << "\n";
+    }
+
+    duration<double> elapsed = steady_clock::now() - startTime_;
+    out << "# TYPE osn_elapsed_seconds gauge\n";
+    out << "osn_elapsed_seconds " << elapsed.count() << "\n";
+    return out.str();
+}
+
+} } // namespace dg { namespace osn {
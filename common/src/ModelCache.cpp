@@ -0,0 +1,87 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "ModelCache.h"
+
+#include <classification/GbdxModelReader.h>
+#include <OpenSpaceNetArgs.h>
+#include <utility/Logging.h>
+
+namespace dg { namespace osn {
+
+using namespace dg::deepcore::classification;
+
+using std::lock_guard;
+using std::move;
+using std::mutex;
+using std::string;
+
+ModelCache::ModelCache(size_t capacity, bool useGpu, float maxUtilization) :
+    capacity_(capacity),
+    useGpu_(useGpu),
+    maxUtilization_(maxUtilization)
+{
+    DG_CHECK(capacity_ > 0, "Model cache capacity must be at least 1");
+}
+
+Model::Ptr ModelCache::get(const string& path)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    auto it = index_.find(path);
+    if(it != index_.end()) {
+        models_.splice(models_.begin(), models_, it->second);
+        return it->second->second;
+    }
+
+    OSN_LOG(info) << "Loading model " << path << "...";
+
+    GbdxModelReader modelReader(path);
+    auto modelPackage = modelReader.readModel();
+    DG_CHECK(modelPackage, "Unable to open the model package %s", path.c_str());
+
+    auto model = Model::create(*modelPackage, useGpu_, maxUtilization_);
+    models_.emplace_front(path, model);
+    index_[path] = models_.begin();
+    trim();
+
+    return model;
+}
+
+void ModelCache::put(const string& path, Model::Ptr model)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    auto it = index_.find(path);
+    if(it != index_.end()) {
+        models_.erase(it->second);
+    }
+
+    models_.emplace_front(path, move(model));
+    index_[path] = models_.begin();
+    trim();
+}
+
+void ModelCache::trim()
+{
+    while(models_.size() > capacity_) {
+        OSN_LOG(info) << "Unloading model " << models_.back().first;
+        index_.erase(models_.back().first);
+        models_.pop_back();
+    }
+}
+
+} } // namespace dg { namespace osn {
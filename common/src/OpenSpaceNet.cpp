@@ -19,15 +19,28 @@
 #include <OpenSpaceNetVersion.h>
 
 #include <include/OpenSpaceNetArgs.h>
-
+#include <include/ChipScreen.h>
+#include <include/MetricsWriter.h>
+#include <include/ShardMerger.h>
+#include <include/TileCache.h>
+#include <include/TraceWriter.h>
+
+#include <algorithm>
+#include <atomic>
 #include <boost/algorithm/string.hpp>
 #include <boost/range/combine.hpp>
 #include <boost/date_time.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/make_unique.hpp>
+#include <cctype>
 #include <classification/Classification.h>
 #include <classification/CaffeSegmentation.h>
+#include <classification/GbdxModelReader.h>
 #include <classification/Nodes.h>
+#include <fstream>
+#include <future>
+#include <gdal_priv.h>
 #include <geometry/AffineTransformation.h>
 #include <geometry/MaskedRegionFilter.h>
 #include <geometry/Nodes.h>
@@ -40,11 +53,16 @@
 #include <imagery/MapBoxClient.h>
 #include <imagery/Nodes.h>
 #include <imagery/RasterToPolygonDP.h>
+#include <mutex>
+#include <ogr_spatialref.h>
+#include <numeric>
 #include <process/Metrics.h>
+#include <set>
+#include <sstream>
+#include <sys/resource.h>
 #include <utility/Memory.h>
 #include <utility/ProgressDisplayHelper.h>
 #include <utility/User.h>
-#include <vector/FileFeatureSet.h>
 #include <vector/Nodes.h>
 #include <vector/Vector.h>
 
@@ -60,6 +78,7 @@ using namespace dg::deepcore::network;
 using namespace dg::deepcore::vector;
 using namespace dg::deepcore::vector::node;
 
+using boost::filesystem::path;
 using boost::format;
 using boost::is_any_of;
 using boost::join;
@@ -84,6 +103,45 @@ using dg::deepcore::NodeState;
 using dg::deepcore::ProgressDisplayHelper;
 using dg::deepcore::Value;
 
+// Number of strips each inference worker processes on average
+static const int STRIPS_PER_WORKER = 4;
+
+// Smallest percent of the GPU memory that one loaded model may use
+static const float MIN_REPLICA_UTILIZATION = 5;
+
+// Seconds between writes of the metrics file
+static const int METRICS_INTERVAL = 5;
+
+// Initial number of connections when the map service downloads are adapted
+static const int INITIAL_CONNECTIONS = 4;
+
+// The detector is considered starved when fewer windows than this wait for it on average
+static const double STARVED_BACKLOG = 16;
+
+// A drop of the read rate below this fraction of the previous strip signals throttling
+static const double THROTTLED_RATE = 0.75;
+
+// Number of points along each edge of the bounding box when it is transformed to the projection of a region file
+static const int BBOX_DENSIFY_POINTS = 32;
+
+// Returns the format of the files that a pass writes to its own directory, which are merged into
+// the output later. They are written in the output format, so that they have the same fields as the
+// output, except for the database formats.
+static string passFormat(const string& outputFormat)
+{
+    if(outputFormat == "postgis" || outputFormat == "elasticsearch") {
+        return "geojson";
+    }
+
+    return outputFormat;
+}
+
+// Returns the path of the file that a pass writes the features of a model to
+static string passOutput(const string& passDir, const string& modelName, const string& format)
+{
+    return (path(passDir) / (modelName + "." + format)).string();
+}
+
 OpenSpaceNet::OpenSpaceNet(OpenSpaceNetArgs&& args) :
     args_(move(args))
 {
@@ -97,60 +155,994 @@ void OpenSpaceNet::process()
     deepcore::classification::init(); 
     deepcore::vector::init();
 
-    GeoBlockSource::Ptr blockSource;
-    if(args_.source > Source::LOCAL) {
-        OSN_LOG(info) << "Opening map service image..." ;
-        blockSource = initMapServiceImage();
-    } else if(args_.source == Source::LOCAL) {
-        OSN_LOG(info) << "Opening local image..." ;
-        blockSource = initLocalImage();
+    if(!args_.metricsPath.empty()) {
+        metrics_ = make_unique<MetricsWriter>(args_.metricsPath, std::chrono::seconds(METRICS_INTERVAL));
+    }
+    if(!args_.tracePath.empty()) {
+        trace_ = make_unique<TraceWriter>(args_.tracePath);
+    }
+
+    if(args_.action == Action::BATCH) {
+        processBatch();
+        return;
+    }
+
+    // The image and the models do not depend on each other, so the image is opened, which
+    // connects to the map service for web sources, while the models are loaded. The region
+    // filter files are read as soon as the image is open.
+    auto startTime = high_resolution_clock::now();
+    auto image = async(std::launch::async, [this, startTime] {
+        {
+            TraceSpan span(trace_.get(), "open image");
+            initImage();
+        }
+        duration<double> openTime = high_resolution_clock::now() - startTime;
+        OSN_LOG(info) << "Image opened in " << openTime.count() << " s";
+        TraceSpan span(trace_.get(), "read region files");
+        readRegionFiles();
+    });
+
+    //Note: Model must be initialized before sliding window
+    //and subset filter for model size and stepping
+    OSN_LOG(info) << "Reading model..." ;
+    try {
+        TraceSpan span(trace_.get(), "load models");
+        initModels();
+    } catch(...) {
+        image.wait();
+        throw;
+    }
+    duration<double> loadTime = high_resolution_clock::now() - startTime;
+    OSN_LOG(info) << "Models loaded in " << loadTime.count() << " s";
+
+    image.get();
+
+    detect();
+}
+
+void OpenSpaceNet::processBatch()
+{
+    DG_CHECK(!args_.batchItems.empty(), "Batch manifest does not contain any images");
+
+    OSN_LOG(info) << "Reading model..." ;
+    {
+        TraceSpan span(trace_.get(), "load models");
+        initModels();
+    }
+
+    // The next image is opened while the current one is being processed, so that
+    // the (possibly remote) dataset open overlaps with inference
+    auto openImage = [](const string& path) { return make_unique<GdalImage>(path); };
+    auto nextImage = async(std::launch::async, openImage, args_.batchItems.front().image);
+
+    size_t failed = 0;
+    for(size_t i = 0; i < args_.batchItems.size(); ++i) {
+        auto& item = args_.batchItems[i];
+        OSN_LOG(info) << "Processing image " << i + 1 << " of " << args_.batchItems.size() << ": " << item.image;
+
+        auto image = move(nextImage);
+        if(i + 1 < args_.batchItems.size()) {
+            nextImage = async(std::launch::async, openImage, args_.batchItems[i + 1].image);
+        }
+
+        try {
+            TraceSpan span(trace_.get(), "process image");
+            args_.image = item.image;
+            args_.bbox = move(item.bbox);
+            args_.outputPath = item.outputPath;
+            args_.layerName = item.layerName;
+
+            initLocalImage(image.get(), item.image);
+            detect();
+        } catch(const deepcore::Error& e) {
+            DG_ERROR_LOG(OpenSpaceNet, e);
+            ++failed;
+        } catch(const std::exception& e) {
+            OSN_LOG(error) << e.what();
+            ++failed;
+        }
+    }
+
+    DG_CHECK(!failed, "%d of %d batch images failed to process", (int) failed, (int) args_.batchItems.size());
+}
+
+void OpenSpaceNet::detect()
+{
+    if(args_.maxCacheSize > 0) {
+        OSN_LOG(info) << "Maximum raster cache size is set to " << prettyBytes(args_.maxCacheSize);
+    } else {
+        OSN_LOG(info) << "Maximum raster cache size is not limited";
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(progressMutex_);
+        progressTotals_.clear();
+    }
+
+    Pass pass;
+    pass.aoi = bbox_;
+    pass.openMode = args_.append ? APPEND : OVERWRITE;
+
+    // The AOI of this process is split into strips on the window grid, see calcStrip()
+    bool splitAoi = args_.shardCount > 1 || args_.checkpointStrips || args_.inferenceWorkers > 1;
+    StripGrid grid;
+    int beginCell = 0;
+    int endCell = 0;
+    if(splitAoi) {
+        grid = calcStripGrid();
+        endCell = grid.cells;
+    }
+
+    if(args_.shardCount > 1) {
+        DG_CHECK(args_.shardCount <= grid.cells, "The area of interest is too small to be split into %d shards",
+                 args_.shardCount);
+        beginCell = (int) ((int64_t) grid.cells * args_.shardIndex / args_.shardCount);
+        endCell = (int) ((int64_t) grid.cells * (args_.shardIndex + 1) / args_.shardCount);
+
+        pass.aoi = calcStrip(grid, beginCell, endCell);
+        pass.origins = calcStripOrigins(grid, beginCell, endCell);
+        OSN_LOG(info) << "Processing shard " << args_.shardIndex << "/" << args_.shardCount
+                      << ", pixel area " << pass.aoi.tl() << " : " << pass.aoi.br();
+    }
+
+    initRegionFilter();
+
+    screenFilter_.reset();
+    if(args_.screen && args_.source == Source::LOCAL) {
+        screenChips(pass.aoi);
+    }
+
+    cascadeFilter_.reset();
+    if(args_.cascade) {
+        runCascade(pass.aoi);
+    }
+
+    if(!splitAoi) {
+        auto superTileSize = args_.autoSuperTile ? calcSuperTileSize() : args_.superTileSize;
+        if(superTileSize) {
+            detectSuperTiles(pass, superTileSize);
+        } else if(regionBounds_ && args_.source > Source::LOCAL) {
+            detectRegions(pass);
+        } else if(adaptiveDownloads()) {
+            // The connections are adapted between strips, nothing is journaled
+            grid = calcStripGrid();
+            int strips = std::min(args_.adaptiveStrips, grid.cells);
+            vector<std::pair<cv::Rect, cv::Rect>> parts;
+            for(int strip = 0; strip < strips; ++strip) {
+                auto stripBegin = (int) ((int64_t) grid.cells * strip / strips);
+                auto stripEnd = (int) ((int64_t) grid.cells * (strip + 1) / strips);
+                parts.emplace_back(calcStrip(grid, stripBegin, stripEnd), calcStripOrigins(grid, stripBegin, stripEnd));
+            }
+            detectParts(pass, parts, "strip");
+        } else {
+            detectArea(pass);
+        }
+        return;
+    }
+
+    if(args_.inferenceWorkers > 1) {
+        detectParallel(grid, beginCell, endCell, pass.openMode);
+        return;
+    } else if(!args_.checkpointStrips) {
+        detectArea(pass);
+        return;
+    }
+
+    // Every strip is written to its own file next to the journal, and the strips are merged into
+    // the output when all of them are done. An interrupted strip leaves nothing in the output, and
+    // is written again from the start on resume.
+    int strips = std::min(args_.checkpointStrips, endCell - beginCell);
+    std::set<int> done;
+    auto journal = openJournal(strips, done);
+    auto stripDir = journalPath() + ".strips";
+    if(!done.empty()) {
+        OSN_LOG(info) << "Resuming, " << done.size() << " of " << strips << " strips are already done";
     } else {
-        DG_ERROR_THROW("Input source not specified");
+        boost::filesystem::remove_all(stripDir);
+    }
+
+    vector<string> stripDirs;
+    for(int strip = 0; strip < strips; ++strip) {
+        stripDirs.push_back((path(stripDir) / lexical_cast<string>(strip)).string());
+    }
+
+    auto openMode = pass.openMode;
+    for(int strip = 0; strip < strips; ++strip) {
+        if(done.count(strip)) {
+            continue;
+        }
+
+        auto stripBegin = beginCell + (int) ((int64_t) (endCell - beginCell) * strip / strips);
+        auto stripEnd = beginCell + (int) ((int64_t) (endCell - beginCell) * (strip + 1) / strips);
+        pass.aoi = calcStrip(grid, stripBegin, stripEnd);
+        pass.origins = calcStripOrigins(grid, stripBegin, stripEnd);
+        OSN_LOG(info) << "Processing strip " << strip + 1 << " of " << strips
+                      << ", pixel area " << pass.aoi.tl() << " : " << pass.aoi.br();
+
+        pass.openMode = OVERWRITE;
+        pass.outputDir = stripDirs[strip];
+        boost::filesystem::remove_all(pass.outputDir);
+        boost::filesystem::create_directories(pass.outputDir);
+
+        auto stats = detectArea(pass);
+        if(adaptiveDownloads()) {
+            adaptConnections(stats);
+        }
+
+        // A strip is journaled only after its features have been written and its file closed, a
+        // failure in between causes the strip to be processed again on resume
+        journal << "done " << strip << std::endl;
+        DG_CHECK(journal, "Unable to write the checkpoint journal %s", journalPath().c_str());
     }
 
+    mergePasses(stripDirs, openMode);
+
+    journal.close();
+    boost::filesystem::remove(journalPath());
+    boost::filesystem::remove_all(stripDir);
+}
+
+void OpenSpaceNet::screenChips(const cv::Rect& aoi)
+{
+    OSN_LOG(info) << "Screening the image for no-data and uniform areas..." ;
+    TraceSpan span(trace_.get(), "screen chips");
+
+    // Cells match the window grid of the region filter, so a window is skipped only if every cell
+    // it touches was rejected
+    auto step = models_.front().primaryWindowStep;
+    ChipScreen screen(args_.image, args_.screenMaxInvalid / 100, args_.screenMinStdDev);
+    auto cells = screen.screen(aoi, cv::Size(step.x, step.y));
+
+    vector<Polygon> regions;
+    for(const auto& cell : cells) {
+        regions.emplace_back(LinearRing(cell));
+    }
+
+    screenFilter_ = MaskedRegionFilter::create(cv::Rect(0, 0, bbox_.width, bbox_.height), step,
+                                               MaskedRegionFilter::FilterMethod::ANY);
+    if(!regions.empty()) {
+        screenFilter_->add(regions);
+    }
+
+    OSN_LOG(info) << screen.rejectedCells() << " of " << screen.rejectedCells() + cells.size()
+                  << " image cells are skipped by chip screening";
+    if(progressCallback_) {
+        progressCallback_("screened", (int64_t) screen.rejectedCells());
+    }
+    if(metrics_) {
+        metrics_->add("osn_screened_cells_total", "", (double) screen.rejectedCells());
+    }
+}
+
+void OpenSpaceNet::runCascade(const cv::Rect& aoi)
+{
+    OSN_LOG(info) << "Running the cascade pass..." ;
+    TraceSpan span(trace_.get(), "cascade");
+
+    initCascadeModels();
+
+    auto tempDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("osn-%%%%-%%%%-%%%%");
+    boost::filesystem::create_directories(tempDir);
+
+    Pass pass;
+    pass.aoi = aoi;
+    pass.openMode = OVERWRITE;
+    pass.models = &cascadeModels_;
+    pass.outputDir = tempDir.string();
+
+    try {
+        detectArea(pass);
+    } catch(...) {
+        boost::filesystem::remove_all(tempDir);
+        throw;
+    }
+
+    // Full resolution windows are only processed around the cascade detections. The neighborhood
+    // of a detection extends by one coarse step, which covers objects that the coarse windows only
+    // partially contained.
+    unique_ptr<Transformation> toPixel(pixelToLL_->inverse());
+    vector<Polygon> regions;
+    for(const auto& model : cascadeModels_) {
+        auto margin = std::max(model.primaryWindowStep.x, model.primaryWindowStep.y);
+        for(const auto& envelope : readEnvelopes(passOutput(tempDir.string(), model.name, "geojson"))) {
+            cv::Rect region = toPixel->transformToInt(envelope);
+            region.x -= margin;
+            region.y -= margin;
+            region.width += 2 * margin;
+            region.height += 2 * margin;
+            regions.emplace_back(LinearRing(region));
+        }
+    }
+    boost::filesystem::remove_all(tempDir);
+
+    cascadeFilter_ = MaskedRegionFilter::create(cv::Rect(0, 0, bbox_.width, bbox_.height),
+                                                models_.front().primaryWindowStep,
+                                                MaskedRegionFilter::FilterMethod::ANY);
+    if(!regions.empty()) {
+        cascadeFilter_->add(regions);
+    }
+
+    OSN_LOG(info) << regions.size() << " cascade detections, full resolution processing is limited to their neighborhoods";
+}
+
+vector<cv::Rect2d> OpenSpaceNet::readEnvelopes(const string& path)
+{
+    GDALAllRegister();
+
+    unique_ptr<GDALDataset, void (*)(GDALDataset*)> dataset(
+        (GDALDataset*) GDALOpenEx(path.c_str(), GDAL_OF_VECTOR | GDAL_OF_READONLY, nullptr, nullptr, nullptr),
+        [](GDALDataset* dataset) { GDALClose(dataset); });
+    DG_CHECK(dataset, "Unable to open %s", path.c_str());
+
+    vector<cv::Rect2d> envelopes;
+    for(int i = 0; i < dataset->GetLayerCount(); ++i) {
+        auto layer = dataset->GetLayer(i);
+        layer->ResetReading();
+
+        OGRFeature* feature;
+        while((feature = layer->GetNextFeature()) != nullptr) {
+            auto geometry = feature->GetGeometryRef();
+            if(geometry) {
+                OGREnvelope envelope;
+                geometry->getEnvelope(&envelope);
+                envelopes.emplace_back(cv::Point2d(envelope.MinX, envelope.MinY),
+                                       cv::Point2d(envelope.MaxX, envelope.MaxY));
+            }
+            OGRFeature::DestroyFeature(feature);
+        }
+    }
+
+    return envelopes;
+}
+
+void OpenSpaceNet::detectParallel(const StripGrid& grid, int beginCell, int endCell, VectorOpenMode openMode)
+{
+    // Every worker runs its own processing graph with its own model replicas. Workers take the
+    // next unprocessed strip when they finish one, and there are several strips per worker, so
+    // that the load stays balanced when some strips take longer than others.
+    int workers = std::min(args_.inferenceWorkers, (int) models_.front().replicas.size());
+    if(workers < args_.inferenceWorkers) {
+        OSN_LOG(warning) << "Only " << workers << " replicas of the model are loaded, using " << workers
+                         << " inference workers instead of " << args_.inferenceWorkers;
+    }
+
+    int strips = std::min(workers * STRIPS_PER_WORKER, endCell - beginCell);
+    OSN_LOG(info) << "Processing " << strips << " strips with " << workers << " inference workers";
+
+    auto tempDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("osn-%%%%-%%%%-%%%%");
+    boost::filesystem::create_directories(tempDir);
+
+    std::atomic<int> nextStrip(0);
+    std::atomic<int> stripsDone(0);
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    // The workers share one progress display, which shows the progress summed over all strips
+    bool showProgress = !args_.quiet && pd_;
+    if(showProgress) {
+        pd_->start();
+    }
+
+    vector<thread> threads;
+    for(int worker = 0; worker < workers; ++worker) {
+        threads.emplace_back([&, worker] {
+            for(int strip = nextStrip++; strip < strips; strip = nextStrip++) {
+                try {
+                    auto stripBegin = beginCell + (int) ((int64_t) (endCell - beginCell) * strip / strips);
+                    auto stripEnd = beginCell + (int) ((int64_t) (endCell - beginCell) * (strip + 1) / strips);
+                    Pass pass;
+                    pass.aoi = calcStrip(grid, stripBegin, stripEnd);
+                    pass.origins = calcStripOrigins(grid, stripBegin, stripEnd);
+                    pass.openMode = OVERWRITE;
+                    pass.replica = worker;
+                    pass.outputDir = (tempDir / lexical_cast<string>(strip)).string();
+                    pass.ownDisplay = false;
+
+                    boost::filesystem::create_directories(pass.outputDir);
+                    detectArea(pass);
+
+                    OSN_LOG(info) << "Finished " << ++stripsDone << " of " << strips << " strips";
+                } catch(...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if(!error) {
+                        error = std::current_exception();
+                    }
+                    nextStrip = strips;
+                }
+            }
+        });
+    }
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    if(showProgress) {
+        pd_->stop();
+    }
+
+    if(error) {
+        boost::filesystem::remove_all(tempDir);
+        std::rethrow_exception(error);
+    }
+
+    // The strip outputs are combined in strip order, so the output does not depend on which
+    // worker processed which strip
+    vector<string> stripDirs;
+    for(int strip = 0; strip < strips; ++strip) {
+        stripDirs.push_back((tempDir / lexical_cast<string>(strip)).string());
+    }
+
+    try {
+        mergePasses(stripDirs, openMode);
+    } catch(...) {
+        boost::filesystem::remove_all(tempDir);
+        throw;
+    }
+
+    boost::filesystem::remove_all(tempDir);
+}
+
+void OpenSpaceNet::mergePasses(const vector<string>& passDirs, VectorOpenMode openMode)
+{
+    // The passes write polygons without non-maximum suppression, see initBranch(), so the merge
+    // suppresses the overlapping features of all passes at once and then converts them to points
+    // if requested. The result does not depend on where the area was split.
+    int64_t features = 0;
+    for(const auto& model : models_) {
+        OpenSpaceNetArgs mergeArgs;
+        for(const auto& passDir : passDirs) {
+            mergeArgs.mergeInputs.push_back(passOutput(passDir, model.name, passFormat(args_.outputFormat)));
+        }
+        outputFor(model, mergeArgs.outputPath, mergeArgs.layerName);
+        mergeArgs.outputFormat = args_.outputFormat;
+        mergeArgs.append = openMode == APPEND;
+        mergeArgs.nms = args_.nms;
+        mergeArgs.overlap = args_.overlap;
+        mergeArgs.geometryType = args_.geometryType;
+
+        ShardMerger merger(move(mergeArgs), true);
+        merger.process();
+        features += merger.featuresWritten();
+    }
+
+    // The features reported by the passes include the ones that the merge removed
+    if(progressCallback_) {
+        progressCallback_("features", features);
+    }
+}
+
+void OpenSpaceNet::detectRegions(Pass pass)
+{
+    // Map service tiles are only downloaded for the area that the sliding windows cover. The area
+    // of interest is processed in runs of strips that touch the include regions, so that the tiles
+    // of the strips in between are never requested.
+    auto grid = calcStripGrid();
+    vector<std::pair<int, int>> runs;
+    for(int cell = 0; cell < grid.cells; ++cell) {
+        auto strip = calcStrip(grid, cell, cell + 1);
+        if(!clipToRegions(strip)) {
+            continue;
+        }
+
+        if(!runs.empty() && runs.back().second == cell) {
+            runs.back().second = cell + 1;
+        } else {
+            runs.emplace_back(cell, cell + 1);
+        }
+    }
+
+    if(runs.empty()) {
+        OSN_LOG(warning) << "The include regions do not intersect the bounding box";
+        detectArea(pass);
+        return;
+    }
+
+    // A window that extends into the next run is processed only by the run that owns its origin
+    vector<std::pair<cv::Rect, cv::Rect>> parts;
+    for(const auto& run : runs) {
+        parts.emplace_back(calcStrip(grid, run.first, run.second), calcStripOrigins(grid, run.first, run.second));
+    }
+
+    detectParts(pass, parts, "region");
+}
+
+void OpenSpaceNet::detectParts(Pass pass, const vector<std::pair<cv::Rect, cv::Rect>>& parts, const string& partName)
+{
+    // Every part is given by its area and the area of its window origins. Without non-maximum
+    // suppression the features of the parts are appended to the output as they are. With it, the
+    // parts are written to temporary files and merged with one suppression over all of them, so
+    // that objects on the border of two parts are reported only once.
+    path tempDir;
+    vector<string> partDirs;
+    auto openMode = pass.openMode;
+    if(args_.nms) {
+        tempDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("osn-%%%%-%%%%-%%%%");
+    }
+
+    try {
+        for(size_t part = 0; part < parts.size(); ++part) {
+            pass.aoi = parts[part].first;
+            pass.origins = parts[part].second;
+            OSN_LOG(debug) << "Processing " << partName << " " << part + 1 << " of " << parts.size()
+                           << ", pixel area " << pass.aoi.tl() << " : " << pass.aoi.br();
+
+            if(args_.nms) {
+                pass.openMode = OVERWRITE;
+                pass.outputDir = (tempDir / lexical_cast<string>(part)).string();
+                boost::filesystem::create_directories(pass.outputDir);
+                partDirs.push_back(pass.outputDir);
+            }
+
+            auto stats = detectArea(pass);
+            if(adaptiveDownloads()) {
+                adaptConnections(stats);
+            }
+            pass.openMode = APPEND;
+        }
+
+        if(args_.nms) {
+            mergePasses(partDirs, openMode);
+        }
+    } catch(...) {
+        if(args_.nms) {
+            boost::filesystem::remove_all(tempDir);
+        }
+        throw;
+    }
+
+    if(args_.nms) {
+        boost::filesystem::remove_all(tempDir);
+    }
+}
+
+// Returns the position of the d-th cell along the Hilbert curve that fills a grid of n by n
+// cells, n must be a power of two
+static cv::Point hilbertCell(int n, int64_t d)
+{
+    cv::Point cell;
+    for(int s = 1; s < n; s *= 2) {
+        int rx = (int) (1 & (d / 2));
+        int ry = (int) (1 & (d ^ rx));
+        if(!ry) {
+            if(rx) {
+                cell.x = s - 1 - cell.x;
+                cell.y = s - 1 - cell.y;
+            }
+            std::swap(cell.x, cell.y);
+        }
+        cell.x += s * rx;
+        cell.y += s * ry;
+        d /= 4;
+    }
+    return cell;
+}
+
+void OpenSpaceNet::detectSuperTiles(Pass pass, int superTileSize)
+{
+    // The sliding windows walk their AOI row by row, so the blocks of a whole row of windows
+    // must stay in the cache. Processing the AOI in square super-tiles bounds this working set by
+    // the super-tile width. The super-tiles are aligned to the window grid like strips are, and
+    // are visited along a Hilbert curve, so consecutive super-tiles are neighbors and share the
+    // blocks on their common border.
+    auto rows = calcStripGrid(true);
+    auto columns = calcStripGrid(false);
+    int rowCells = std::max(superTileSize / rows.cellSize, 1);
+    int columnCells = std::max(superTileSize / columns.cellSize, 1);
+    int tilesY = (rows.cells + rowCells - 1) / rowCells;
+    int tilesX = (columns.cells + columnCells - 1) / columnCells;
+
+    int curveSize = 1;
+    while(curveSize < std::max(tilesX, tilesY)) {
+        curveSize *= 2;
+    }
+
+    OSN_LOG(info) << "Processing " << tilesX * tilesY << " super-tiles in Hilbert curve order";
+
+    // A super-tile owns the window origins in its cells, like a strip does
+    vector<std::pair<cv::Rect, cv::Rect>> parts;
+    int64_t readBlocks = 0;
+    for(int64_t d = 0; d < (int64_t) curveSize * curveSize; ++d) {
+        auto cell = hilbertCell(curveSize, d);
+        if(cell.x >= tilesX || cell.y >= tilesY) {
+            continue;
+        }
+
+        int rowBegin = cell.y * rowCells;
+        int rowEnd = std::min((cell.y + 1) * rowCells, rows.cells);
+        int columnBegin = cell.x * columnCells;
+        int columnEnd = std::min((cell.x + 1) * columnCells, columns.cells);
+        parts.emplace_back(calcStrip(rows, rowBegin, rowEnd) & calcStrip(columns, columnBegin, columnEnd),
+                           calcStripOrigins(rows, rowBegin, rowEnd) & calcStripOrigins(columns, columnBegin, columnEnd));
+        readBlocks += countBlocks(parts.back().first);
+    }
+
+    detectParts(pass, parts, "super-tile");
+
+    // Super-tiles overlap by the part of the windows that extends past their border, and every
+    // pass has its own block cache, so the blocks on the border are read twice. This is estimated
+    // from the super-tile geometry, the reads themselves are not counted.
+    auto blocks = countBlocks(bbox_);
+    OSN_LOG(info) << format("Estimated super-tile re-read rate is %.1f%% of the blocks") % (100.0 * (readBlocks - blocks) / blocks);
+}
+
+int64_t OpenSpaceNet::countBlocks(const cv::Rect& area) const
+{
+    if(!area.area()) {
+        return 0;
+    }
+
+    auto columns = (area.x + area.width - 1) / blockSize_.width - area.x / blockSize_.width + 1;
+    auto rows = (area.y + area.height - 1) / blockSize_.height - area.y / blockSize_.height + 1;
+    return (int64_t) columns * rows;
+}
+
+// Returns the name of the exported metric of a progress value
+static string metricName(const string& progressName)
+{
+    if(progressName == "windows") {
+        return "osn_windows_total";
+    } else if(progressName == "read") {
+        return "osn_windows_read_total";
+    } else if(progressName == "processed") {
+        return "osn_windows_processed_total";
+    }
+
+    return "osn_" + progressName + "_total";
+}
+
+// Returns the name of the trace event of a progress value, or an empty string if it is not traced
+static string traceName(const string& progressName)
+{
+    if(progressName == "read") {
+        return "window cut";
+    } else if(progressName == "processed") {
+        return "inference";
+    } else if(progressName == "features") {
+        return "feature write";
+    }
+
+    return string();
+}
+
+OpenSpaceNet::PassStats OpenSpaceNet::detectArea(Pass pass)
+{
+    const auto& models = pass.models ? *pass.models : models_;
+    TraceSpan span(trace_.get(), pass.models ? "cascade pass" : "pass");
+
+    // The sliding windows only cover the part of the area that can pass the region filter, so that
+    // the blocks outside of it are never read
+    if(!pass.models) {
+        clipToRegions(pass.aoi);
+    }
+
+    auto blockSource = createBlockSource_();
+
     auto blockCache = BlockCache::create("blockCache");
     blockCache->connectAttrs(*blockSource);
     blockCache->attr("bufferSize") = args_.maxCacheSize / 2;
 
-    if(args_.maxCacheSize > 0) {
-        OSN_LOG(info) << "Maximum raster cache size is set to " << prettyBytes(args_.maxCacheSize);
+    auto subsetWithBorder = SubsetWithBorder::create("border");
+    if(args_.resampledSize) {
+        cv::Size paddedSize;
+        for(const auto& model : models) {
+            paddedSize.width = std::max(paddedSize.width, model.metadata->modelSize().width);
+            paddedSize.height = std::max(paddedSize.height, model.metadata->modelSize().height);
+        }
+        subsetWithBorder->attr("paddedSize") = paddedSize;
+    }
+    subsetWithBorder->connectAttrs(*blockSource);
+
+    // Region filters are chained, a window is processed only if it passes all of them
+    vector<SubsetRegionFilter::Ptr> subsetFilters;
+    if(regionFilter_) {
+        auto subsetFilter = SubsetRegionFilter::create("regionFilter");
+        subsetFilter->attr("regionFilter") = regionFilter_;
+        subsetFilters.push_back(subsetFilter);
+    }
+
+    if(screenFilter_) {
+        auto screenFilter = SubsetRegionFilter::create("screenFilter");
+        screenFilter->attr("regionFilter") = screenFilter_;
+        subsetFilters.push_back(screenFilter);
+    }
+
+    if(!pass.models && cascadeFilter_) {
+        auto cascadeFilter = SubsetRegionFilter::create("cascadeFilter");
+        cascadeFilter->attr("regionFilter") = cascadeFilter_;
+        subsetFilters.push_back(cascadeFilter);
+    }
+
+    // The cells of the origin filter are the strip grid cells, so a window touches a cell of the
+    // origin area if and only if its origin is in it
+    if(pass.origins.area()) {
+        cv::Point cellSize(calcStripGrid(false).cellSize, calcStripGrid(true).cellSize);
+        auto originFilter = MaskedRegionFilter::create(cv::Rect(0, 0, bbox_.width, bbox_.height), cellSize,
+                                                       MaskedRegionFilter::FilterMethod::ANY);
+        originFilter->add(Polygon(LinearRing(pass.origins)));
+
+        auto stripFilter = SubsetRegionFilter::create("stripFilter");
+        stripFilter->attr("regionFilter") = originFilter;
+        subsetFilters.push_back(stripFilter);
+    }
+
+    // Every model gets its own sliding window and detection branch, which are all
+    // fed from the same cached subsets, so the image is only read once
+    vector<Branch> branches;
+    for(const auto& model : models) {
+        branches.push_back(initBranch(model, blockSource, pass));
+    }
+
+    RemoveBandByColorInterp::Ptr removeAlpha;
+    if(haveAlpha_) {
+        removeAlpha = RemoveBandByColorInterp::create("removeAlpha");
+        removeAlpha->attr("bandToRemove") = ColorInterpretation::ALPHA_BAND;
+        removeAlpha->connectAttrs(*blockSource);
+
+        blockCache->connectAttrs(*removeAlpha);
+        subsetWithBorder->connectAttrs(*removeAlpha);
+        for(auto& branch : branches) {
+            branch.slidingWindow->connectAttrs(*removeAlpha);
+        }
+    }
+
+    if(removeAlpha) {
+        removeAlpha->input("blocks") = blockSource->output("blocks");
+        blockCache->input("blocks") = removeAlpha->output("blocks");
     } else {
-        OSN_LOG(info) << "Maximum raster cache size is not limited";
+        blockCache->input("blocks") = blockSource->output("blocks");
     }
 
-    //Note: Model must be initialized before sliding window
-    //and subset filter for model size and stepping
-    OSN_LOG(info) << "Reading model..." ;
-    auto model = initDetector();
+    subsetWithBorder->input("subsets") = blockCache->output("subsets");
+    for(size_t i = 0; i < subsetFilters.size(); ++i) {
+        if(i == 0) {
+            subsetFilters[i]->input("subsets") = subsetWithBorder->output("subsets");
+        } else {
+            subsetFilters[i]->input("subsets") = subsetFilters[i - 1]->output("subsets");
+        }
+    }
+
+    for(auto& branch : branches) {
+        if (!subsetFilters.empty()) {
+            branch.slidingWindow->input("subsets") = subsetFilters.back()->output("subsets");
+        } else {
+            branch.slidingWindow->input("subsets") = subsetWithBorder->output("subsets");
+        }
+    }
+
+    // Metric values of each branch. The progress of a detection pass is reported as the sum over
+    // all branches and all passes so far, the progress of the cascade pass as its own sum.
+    std::mutex progressMutex;
+    map<string, vector<int64_t>> progressValues;
+    auto updateProgress = [&progressMutex, &progressValues, &branches, &models, &pass, this] (const string& name, size_t branch, Value value) {
+        std::lock_guard<std::mutex> lock(progressMutex);
+        auto& values = progressValues[name];
+        values.resize(branches.size());
+        auto newValue = value.convert<int64_t>();
+        if(metrics_) {
+            metrics_->add(metricName(name), models[branch].name, (double) (newValue - values[branch]));
+        }
+
+        // The units of work are recorded on the thread of the node that finished them
+        if(trace_ && newValue > values[branch]) {
+            auto event = traceName(name);
+            if(!event.empty()) {
+                trace_->instant(event, models[branch].name, newValue - values[branch]);
+            }
+        }
+        auto delta = newValue - values[branch];
+        values[branch] = newValue;
+
+        // Windows that have been read and wait for the model
+        if((metrics_ || trace_) && (name == "read" || name == "processed")) {
+            auto& read = progressValues["read"];
+            auto& processed = progressValues["processed"];
+            read.resize(branches.size());
+            processed.resize(branches.size());
+            auto queued = read[branch] - processed[branch];
+            if(metrics_) {
+                metrics_->set("osn_detector_queue_windows", models[branch].name, queued);
+            }
+            if(trace_) {
+                trace_->counter("detector queue", models[branch].name, (double) queued);
+            }
+        }
+
+        if(pass.models) {
+            return std::accumulate(values.begin(), values.end(), (int64_t) 0);
+        }
+
+        std::lock_guard<std::mutex> totalsLock(progressMutex_);
+        return progressTotals_[name] += delta;
+    };
+
+    // Number of windows read but not yet processed by the first model, sampled whenever it
+    // processes windows
+    double backlog = 0;
+    int64_t backlogSamples = 0;
+
+    auto cancel = [&branches] {
+        for(auto& branch : branches) {
+            branch.featureSink->cancel();
+        }
+    };
+
+    unique_ptr<ProgressDisplayHelper<int64_t>> pdHelper;
+    bool showProgress = !args_.quiet && pd_;
+    if(showProgress) {
+        pdHelper = make_unique<ProgressDisplayHelper<int64_t>>(*pd_);
+    }
+
+    for(size_t i = 0; i < branches.size(); ++i) {
+        auto& branch = branches[i];
+
+        branch.slidingWindow->metric("total").changed().connect(
+            [&, i, this] (const std::weak_ptr<Metric>&, Value value) {
+                auto total = updateProgress("windows", i, value);
+                if(progressCallback_) {
+                    progressCallback_("windows", total);
+                }
+
+                if(showProgress) {
+                    if(!pd_->isRunning()) {
+                        cancel();
+                    } else {
+                        pdHelper->updateMaximum("Reading", total);
+                        pdHelper->updateMaximum("Detecting", total);
+                    }
+                }
+            });
+
+        branch.slidingWindow->metric("forwarded").changed().connect(
+            [&, i, this] (const std::weak_ptr<Metric>&, Value value) {
+                auto total = updateProgress("read", i, value);
+                if(progressCallback_) {
+                    progressCallback_("read", total);
+                }
+
+                if(showProgress) {
+                    if(!pd_->isRunning()) {
+                        cancel();
+                    } else {
+                        pdHelper->updateCurrent("Reading", total);
+                    }
+                }
+            });
+
+        branch.detector->metric("processed").changed().connect(
+            [&, i, this] (const std::weak_ptr<Metric>&, Value value) {
+                auto total = updateProgress("processed", i, value);
+                if(i == 0) {
+                    std::lock_guard<std::mutex> lock(progressMutex);
+                    const auto& read = progressValues["read"];
+                    backlog += (read.empty() ? 0 : read.front()) - value.convert<int64_t>();
+                    ++backlogSamples;
+                }
+
+                if(progressCallback_) {
+                    progressCallback_("processed", total);
+                }
+
+                if(showProgress) {
+                    if(!pd_->isRunning()) {
+                        cancel();
+                    } else {
+                        pdHelper->updateCurrent("Detecting", total);
+                    }
+                }
+            });
+
+        branch.featureSink->metric("processed").changed().connect(
+            [&, i, this] (const std::weak_ptr<Metric>&, Value value) {
+                auto total = updateProgress("features", i, value);
+                if(progressCallback_) {
+                    progressCallback_("features", total);
+                }
+            });
+    }
+
+    auto startTime = high_resolution_clock::now();
+
+    if (showProgress && pass.ownDisplay) {
+        pd_->start();
+
+        for(auto& branch : branches) {
+            branch.featureSink->run();
+        }
+        for(auto& branch : branches) {
+            branch.featureSink->wait(true);
+        }
+
+        pd_->stop();
+    } else {
+        for(auto& branch : branches) {
+            branch.featureSink->run();
+        }
+        for(auto& branch : branches) {
+            branch.featureSink->wait();
+        }
+    }
+
+    PassStats stats;
+    duration<double> duration = high_resolution_clock::now() - startTime;
+    stats.seconds = duration.count();
+    if(metrics_) {
+        metrics_->add("osn_passes_total", "", 1);
+        metrics_->add("osn_pass_seconds_total", "", stats.seconds);
+    }
+    stats.windowsRead = branches.front().slidingWindow->metric("forwarded").convert<int64_t>();
+    stats.meanBacklog = backlogSamples ? backlog / backlogSamples : 0;
+
+    if (!args_.quiet) {
+        skipLine();
+        if(models.size() == 1) {
+            OSN_LOG(info) << branches.front().featureSink->metric("processed").convert<int>() << " features detected.";
+        } else {
+            for(size_t i = 0; i < branches.size(); ++i) {
+                OSN_LOG(info) << branches[i].featureSink->metric("processed").convert<int>()
+                              << " features detected by " << models[i].metadata->name() << ".";
+            }
+        }
+        OSN_LOG(info) << "Processing time " << duration.count() << " s";
+    }
+
+    return stats;
+}
+
+bool OpenSpaceNet::adaptiveDownloads() const
+{
+    // Through the tile cache, GDAL downloads the tiles with a fixed number of connections
+    return args_.adaptiveConnections && args_.source > Source::LOCAL && args_.tileCacheDir.empty();
+}
 
-    printModel();
+void OpenSpaceNet::adaptConnections(const PassStats& stats)
+{
+    // The number of connections is adapted between strips: it grows by one while the detector
+    // waits for windows, and is halved when more connections made the downloads slower
+    double readRate = stats.seconds > 0 ? stats.windowsRead / stats.seconds : 0;
+    int connections = connections_;
+    if(lastReadRate_ > 0 && connections_ > lastConnections_ && readRate < lastReadRate_ * THROTTLED_RATE) {
+        connections = std::max(connections_ / 2, 1);
+    } else if(stats.meanBacklog < STARVED_BACKLOG) {
+        connections = std::min(connections_ + 1, args_.maxConnections);
+    }
 
-    auto subsetWithBorder = SubsetWithBorder::create("border");
-    if(args_.resampledSize) {
-        subsetWithBorder->attr("paddedSize") = metadata_->modelSize();
+    OSN_LOG(debug) << "Read " << readRate << " windows/s with " << connections_ << " connections, "
+                   << stats.meanBacklog << " windows waiting on average";
+    if(connections != connections_) {
+        OSN_LOG(info) << "Changing the number of map service connections to " << connections;
     }
-    subsetWithBorder->connectAttrs(*blockSource);
 
-    auto subsetFilter = initSubsetRegionFilter();
-    auto slidingWindow = initSlidingWindow();
-    slidingWindow->connectAttrs(*blockSource);
+    lastConnections_ = connections_;
+    lastReadRate_ = readRate;
+    connections_ = connections;
+    if(progressCallback_) {
+        progressCallback_("connections", connections_);
+    }
+    if(metrics_) {
+        metrics_->set("osn_connections", "", connections_);
+    }
+}
 
-    RemoveBandByColorInterp::Ptr removeAlpha;
-    if(haveAlpha_) {
-        removeAlpha = RemoveBandByColorInterp::create("removeAlpha");
-        removeAlpha->attr("bandToRemove") = ColorInterpretation::ALPHA_BAND;
-        removeAlpha->connectAttrs(*blockSource);
+OpenSpaceNet::Branch OpenSpaceNet::initBranch(const DetectionModel& model, GeoBlockSource::Ptr blockSource,
+                                              const Pass& pass)
+{
+    Branch branch;
+    branch.detector = initDetector(model, pass.replica);
+    branch.slidingWindow = initSlidingWindow(model, pass.aoi);
+    branch.slidingWindow->connectAttrs(*blockSource);
 
-        blockCache->connectAttrs(*removeAlpha);
-        subsetWithBorder->connectAttrs(*removeAlpha);
-        slidingWindow->connectAttrs(*removeAlpha);
-    }
+    bool isSegmentation = model.isSegmentation();
 
-    bool isSegmentation = (metadata_->category() == "segmentation");
+    // The cascade pass keeps every detection, it only has to tell where to look
+    LabelFilter::Ptr labelFilter;
+    if(!model.cascade) {
+        labelFilter = initLabelFilter(isSegmentation);
+    }
 
-    auto labelFilter = initLabelFilter(isSegmentation);
+    // The features of a pass that is merged into the output later are suppressed by the merge
     NonMaxSuppression::Ptr nmsNode;
-    if(args_.nms) {
+    if(args_.nms && !model.cascade && pass.outputDir.empty()) {
         if (isSegmentation) {
             nmsNode = PolyNonMaxSuppression::create("nms");
         } else {
@@ -160,33 +1152,19 @@ void OpenSpaceNet::process()
         nmsNode->attr("overlapThreshold") = args_.overlap / 100;
     }
 
-    auto predictionToFeature = initPredictionToFeature();
+    auto predictionToFeature = initPredictionToFeature(pass);
     auto wfsExtractor = initWfs();
-    auto featureSink = initFeatureSink();
-
-    if(removeAlpha) {
-        removeAlpha->input("blocks") = blockSource->output("blocks");
-        blockCache->input("blocks") = removeAlpha->output("blocks");
-    } else {
-        blockCache->input("blocks") = blockSource->output("blocks");
-    }
-
-    subsetWithBorder->input("subsets") = blockCache->output("subsets");
-    if (subsetFilter) {
-        subsetFilter->input("subsets") = subsetWithBorder->output("subsets");
-        slidingWindow->input("subsets") = subsetFilter->output("subsets");
-    } else {
-        slidingWindow->input("subsets") = subsetWithBorder->output("subsets");
-    }
+    branch.featureSink = initFeatureSink(model, pass);
 
-    model->input("subsets") = slidingWindow->output("subsets");
+    auto& detector = branch.detector;
+    detector->input("subsets") = branch.slidingWindow->output("subsets");
     if (labelFilter) {
-        labelFilter->input("predictions") = model->output("predictions");
+        labelFilter->input("predictions") = detector->output("predictions");
         if (nmsNode) {
             nmsNode->input("predictions") = labelFilter->output("predictions");
         }
     } else if (nmsNode) {
-        nmsNode->input("predictions") = model->output("predictions");
+        nmsNode->input("predictions") = detector->output("predictions");
     }
 
     PredictionBoxToPoly::Ptr toPoly;
@@ -209,68 +1187,20 @@ void OpenSpaceNet::process()
         }
     } else {
         if (isSegmentation) {
-            predictionToFeature->input("predictions") = model->output("predictions");
+            predictionToFeature->input("predictions") = detector->output("predictions");
         } else {
-            toPoly->input("predictions") = model->output("predictions");      
+            toPoly->input("predictions") = detector->output("predictions");      
         }
     }
 
     if (wfsExtractor) {
         wfsExtractor->input("features") = predictionToFeature->output("features");
-        featureSink->input("features") = wfsExtractor->output("features");
-    } else {
-        featureSink->input("features") = predictionToFeature->output("features");
-    }
-
-    auto startTime = high_resolution_clock::now();
-
-    if (!args_.quiet && pd_) {
-        pd_->start();
-
-        ProgressDisplayHelper<int64_t> pdHelper(*pd_);
-
-        auto subsetsRequested = slidingWindow->metric("total").changed().connect(
-            [&pdHelper, &featureSink, this] (const std::weak_ptr<Metric>&, Value value) {
-                if(!pd_->isRunning()) {
-                    featureSink->cancel();
-                } else {
-                    pdHelper.updateMaximum("Reading", value.convert<int64_t>());
-                    pdHelper.updateMaximum("Detecting", value.convert<int64_t>());
-                }
-        });
-
-        auto subsetsRead = slidingWindow->metric("forwarded").changed().connect(
-            [&pdHelper, &featureSink, this] (const std::weak_ptr<Metric>&, Value value) {
-                if(!pd_->isRunning()) {
-                    featureSink->cancel();
-                } else {
-                    pdHelper.updateCurrent("Reading", value.convert<int64_t>());
-                }
-        });
-
-        auto subsetsProcessed = model->metric("processed").changed().connect(
-            [&pdHelper, &featureSink, this] (const std::weak_ptr<Metric>&, Value value) {
-                if(!pd_->isRunning()) {
-                    featureSink->cancel();
-                } else {
-                    pdHelper.updateCurrent("Detecting", value.convert<int64_t>());
-                }
-            });
-
-        featureSink->run();
-        featureSink->wait(true);
-        pd_->stop();
+        branch.featureSink->input("features") = wfsExtractor->output("features");
     } else {
-        featureSink->run();
-        featureSink->wait();
+        branch.featureSink->input("features") = predictionToFeature->output("features");
     }
 
-    if (!args_.quiet) {
-        skipLine();
-        duration<double> duration = high_resolution_clock::now() - startTime;
-        OSN_LOG(info) << featureSink->metric("processed").convert<int>() << " features detected.";
-        OSN_LOG(info) << "Processing time " << duration.count() << " s";
-    }
+    return branch;
 }
 
 void OpenSpaceNet::setProgressDisplay(boost::shared_ptr<deepcore::ProgressDisplay> display)
@@ -282,9 +1212,38 @@ void OpenSpaceNet::setProgressDisplay(boost::shared_ptr<deepcore::ProgressDispla
     });
 }
 
-GeoBlockSource::Ptr OpenSpaceNet::initLocalImage()
+void OpenSpaceNet::setProgressCallback(ProgressCallback callback)
+{
+    progressCallback_ = move(callback);
+}
+
+void OpenSpaceNet::setModels(vector<Model::Ptr> models)
+{
+    presetModels_ = move(models);
+}
+
+void OpenSpaceNet::initImage()
+{
+    if(args_.source > Source::LOCAL && !args_.tileCacheDir.empty()) {
+        OSN_LOG(info) << "Opening map service image through the tile cache..." ;
+        auto description = TileCache(args_).datasetDescription();
+        initLocalImage(make_unique<GdalImage>(description), description);
+        return;
+    } else if(args_.source > Source::LOCAL) {
+        OSN_LOG(info) << "Opening map service image..." ;
+        initMapServiceImage();
+        return;
+    } else if(args_.source == Source::LOCAL) {
+        OSN_LOG(info) << "Opening local image..." ;
+        initLocalImage(make_unique<GdalImage>(args_.image), args_.image);
+        return;
+    }
+
+    DG_ERROR_THROW("Input source not specified");
+}
+
+void OpenSpaceNet::initLocalImage(unique_ptr<GdalImage> image, const string& path)
 {
-    auto image = make_unique<GdalImage>(args_.image);
     imageSize_ = image->size();
     pixelToProj_ = image->pixelToProj().clone();
     imageSr_ = image->spatialReference();
@@ -333,12 +1292,24 @@ GeoBlockSource::Ptr OpenSpaceNet::initLocalImage()
 
     haveAlpha_ = RasterBand::haveAlpha(image->rasterBands());
 
-    GeoBlockSource::Ptr blockSource = GdalBlockSource::create("blockSource");
-    blockSource->attr("path") = args_.image;
-    return blockSource;
+    {
+        GDALAllRegister();
+        unique_ptr<GDALDataset, void (*)(GDALDataset*)> dataset(
+            (GDALDataset*) GDALOpen(path.c_str(), GA_ReadOnly), [](GDALDataset* dataset) { GDALClose(dataset); });
+        DG_CHECK(dataset && dataset->GetRasterCount(), "Unable to open %s", path.c_str());
+        auto band = dataset->GetRasterBand(1);
+        band->GetBlockSize(&blockSize_.width, &blockSize_.height);
+        pixelBytes_ = dataset->GetRasterCount() * GDALGetDataTypeSizeBytes(band->GetRasterDataType());
+    }
+
+    createBlockSource_ = [path]() -> GeoBlockSource::Ptr {
+        GeoBlockSource::Ptr blockSource = GdalBlockSource::create("blockSource");
+        blockSource->attr("path") = path;
+        return blockSource;
+    };
 }
 
-GeoBlockSource::Ptr OpenSpaceNet::initMapServiceImage()
+void OpenSpaceNet::initMapServiceImage()
 {
     DG_CHECK(args_.bbox, "Bounding box must be specified");
 
@@ -393,119 +1364,417 @@ GeoBlockSource::Ptr OpenSpaceNet::initMapServiceImage()
     sr_ = SpatialReference::WGS84;
 
     haveAlpha_ = RasterBand::haveAlpha(client->rasterBands());
+    blockSize_ = cv::Size(256, 256);
+    pixelBytes_ = (int) client->rasterBands().size();
+
+    connections_ = args_.adaptiveConnections ? std::min(INITIAL_CONNECTIONS, args_.maxConnections)
+                                             : args_.maxConnections;
+    lastConnections_ = 0;
+    lastReadRate_ = 0;
+
+    auto config = client->configFromArea(projBbox);
+    createBlockSource_ = [config, this]() -> GeoBlockSource::Ptr {
+        auto blockSource = MapServiceBlockSource::create("blockSource");
+        blockSource->attr("config") = config;
+        blockSource->attr("maxConnections") = connections_;
+        return blockSource;
+    };
+}
+
+static LinearRing toPixelRing(const OGRLinearRing& ring, const Transformation& toPixel, OGREnvelope& bounds)
+{
+    vector<cv::Point2d> points;
+    points.reserve(ring.getNumPoints());
+    for (int i = 0; i < ring.getNumPoints(); ++i) {
+        points.push_back(toPixel.transform(cv::Point2d(ring.getX(i), ring.getY(i))));
+        bounds.Merge(points.back().x, points.back().y);
+    }
+    return LinearRing(points);
+}
+
+OpenSpaceNet::FilterPolygons OpenSpaceNet::readFilterPolygons(const string& path) const
+{
+    GDALAllRegister();
+
+    unique_ptr<GDALDataset, void (*)(GDALDataset*)> dataset(
+        (GDALDataset*) GDALOpenEx(path.c_str(), GDAL_OF_VECTOR | GDAL_OF_READONLY, nullptr, nullptr, nullptr),
+        [](GDALDataset* dataset) { GDALClose(dataset); });
+    DG_CHECK(dataset, "Unable to open %s", path.c_str());
+
+    unique_ptr<Transformation> llToPixel(pixelToLL_->inverse());
+    auto llBbox = pixelToLL_->transform(cv::Rect2d(bbox_));
+
+    // The polygons are transformed in longitude, latitude order, which GDAL 3 no longer uses for
+    // WGS84 by default
+    OGRSpatialReference wgs84;
+    wgs84.SetWellKnownGeogCS("WGS84");
+#if GDAL_VERSION_MAJOR >= 3
+    wgs84.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+#endif
+
+    FilterPolygons polygons;
+    OGREnvelope bounds;
+    for (int i = 0; i < dataset->GetLayerCount(); ++i) {
+        auto layer = dataset->GetLayer(i);
+        auto layerSr = layer->GetSpatialRef();
+        DG_CHECK(layerSr || sr_.isLocal(), "Error applying region filter: %s doesn't have a spatial reference, but the input image does", path.c_str());
+        DG_CHECK(!layerSr || !sr_.isLocal(), "Error applying region filter: Input image doesn't have a spatial reference, but the %s does", path.c_str());
+
+        unique_ptr<OGRCoordinateTransformation> toLL;
+        unique_ptr<OGRCoordinateTransformation> fromLL;
+        if (layerSr) {
+            toLL.reset(OGRCreateCoordinateTransformation(layerSr, &wgs84));
+            fromLL.reset(OGRCreateCoordinateTransformation(&wgs84, layerSr));
+            DG_CHECK(toLL && fromLL, "Error applying region filter: Unable to transform %s to WGS84", path.c_str());
+        }
+
+        // Only the features that intersect the bounding box are read, which lets OGR use the
+        // spatial index of the file, if its format has one. The edges of the bounding box are
+        // densified before it is transformed, because straight edges in WGS84 are curves in
+        // most projections, and a box of the transformed corners alone can miss features.
+        OGRLinearRing bboxRing;
+        bboxRing.addPoint(llBbox.x, llBbox.y);
+        bboxRing.addPoint(llBbox.x + llBbox.width, llBbox.y);
+        bboxRing.addPoint(llBbox.x + llBbox.width, llBbox.y + llBbox.height);
+        bboxRing.addPoint(llBbox.x, llBbox.y + llBbox.height);
+        bboxRing.closeRings();
+        OGRPolygon bboxPolygon;
+        bboxPolygon.addRing(&bboxRing);
+        if (fromLL) {
+            bboxPolygon.segmentize(std::max(llBbox.width, llBbox.height) / BBOX_DENSIFY_POINTS);
+            bboxPolygon.transform(fromLL.get());
+        }
+        layer->SetSpatialFilter(&bboxPolygon);
+        layer->ResetReading();
+
+        OGRFeature* feature;
+        while ((feature = layer->GetNextFeature()) != nullptr) {
+            unique_ptr<OGRFeature, void (*)(OGRFeature*)> featureHolder(
+                feature, [](OGRFeature* feature) { OGRFeature::DestroyFeature(feature); });
+
+            auto geometry = feature->GetGeometryRef();
+            if (!geometry) {
+                continue;
+            }
+
+            auto type = wkbFlatten(geometry->getGeometryType());
+            if (type != wkbPolygon && type != wkbMultiPolygon) {
+                DG_ERROR_THROW("Filter from file \"%s\" contains a geometry that is not a POLYGON", path.c_str());
+            }
+
+            if (toLL) {
+                geometry->transform(toLL.get());
+            }
+
+            vector<const OGRPolygon*> parts;
+            if (type == wkbPolygon) {
+                parts.push_back(static_cast<const OGRPolygon*>(geometry));
+            } else {
+                auto multiPolygon = static_cast<const OGRMultiPolygon*>(geometry);
+                for (int j = 0; j < multiPolygon->getNumGeometries(); ++j) {
+                    parts.push_back(static_cast<const OGRPolygon*>(multiPolygon->getGeometryRef(j)));
+                }
+            }
+
+            for (auto part : parts) {
+                if (!part->getExteriorRing()) {
+                    continue;
+                }
+
+                // Holes are inside the exterior ring, only the exterior ring contributes to the bounds
+                OGREnvelope holeBounds;
+                vector<LinearRing> holes;
+                for (int j = 0; j < part->getNumInteriorRings(); ++j) {
+                    holes.push_back(toPixelRing(*part->getInteriorRing(j), *llToPixel, holeBounds));
+                }
+                polygons.polygons.emplace_back(toPixelRing(*part->getExteriorRing(), *llToPixel, bounds), move(holes));
+            }
+        }
+    }
 
-    auto blockSource = MapServiceBlockSource::create("blockSource");
-    blockSource->attr("config") = client->configFromArea(projBbox);
-    blockSource->attr("maxConnections") = args_.maxConnections;
-    return blockSource;
+    if (bounds.IsInit()) {
+        polygons.bounds = cv::Rect(cv::Point((int) std::floor(bounds.MinX), (int) std::floor(bounds.MinY)),
+                                   cv::Point((int) std::ceil(bounds.MaxX), (int) std::ceil(bounds.MaxY)));
+    }
+    return polygons;
 }
 
-SubsetRegionFilter::Ptr OpenSpaceNet::initSubsetRegionFilter()
+void OpenSpaceNet::initRegionFilter()
 {
+    regionFilter_.reset();
+    regionBounds_.reset();
+
     if (!args_.filterDefinition.empty()) {
         OSN_LOG(info) << "Initializing the subset filter..." ;
+        TraceSpan span(trace_.get(), "region filter");
+
+        regionFilter_ = MaskedRegionFilter::create(cv::Rect(0, 0, bbox_.width, bbox_.height),
+                                                   models_.front().primaryWindowStep,
+                                                   MaskedRegionFilter::FilterMethod::ANY);
 
-        RegionFilter::Ptr regionFilter = MaskedRegionFilter::create(cv::Rect(0, 0, bbox_.width, bbox_.height),
-                                                                    primaryWindowStep_,
-                                                                    MaskedRegionFilter::FilterMethod::ANY);
+        auto startTime = high_resolution_clock::now();
+        readRegionFiles();
+
+        // If the first action is "include", nothing outside of the included polygons passes the
+        // filter, and processing is limited to their bounds
         bool firstAction = true;
+        if (args_.filterDefinition.front().first == "include") {
+            regionBounds_ = make_unique<cv::Rect>();
+        }
+
         for (const auto& filterAction : args_.filterDefinition) {
             string action = filterAction.first;
             std::vector<Polygon> filterPolys;
             for (const auto& filterFile : filterAction.second) {
-                FileFeatureSet filter(filterFile);
-                for (auto& layer : filter) {
-                    auto pixelToProj = dynamic_cast<const TransformationChain&>(*pixelToLL_);
-
-                    if(layer.spatialReference().isLocal() != sr_.isLocal()) {
-                        DG_CHECK(layer.spatialReference().isLocal(), "Error applying region filter: %d doesn't have a spatial reference, but the input image does", filterFile.c_str());
-                        DG_CHECK(sr_.isLocal(), "Error applying region filter: Input image doesn't have a spatial reference, but the %d does", filterFile.c_str());
-                    } else if(!sr_.isLocal()) {
-                        pixelToProj.append(*layer.spatialReference().from(SpatialReference::WGS84));
-                    }
-
-                    auto transform = pixelToProj.inverse();
-                    transform->compact();
-
-                    for (const auto& feature: layer) {
-                        if (feature.type() != GeometryType::POLYGON) {
-                            DG_ERROR_THROW("Filter from file \"%s\" contains a geometry that is not a POLYGON", filterFile.c_str());
-                        }
-                        auto poly = dynamic_cast<Polygon*>(feature.geometry->transform(*transform).release());
-                        filterPolys.emplace_back(move(*poly));
-                    }
+                const auto& filePolys = filterFiles_[filterFile].get();
+                OSN_LOG(debug) << filePolys.polygons.size() << " polygons of " << filterFile << " intersect the bounding box";
+                filterPolys.insert(filterPolys.end(), filePolys.polygons.begin(), filePolys.polygons.end());
+                if (regionBounds_ && action == "include" && !filePolys.polygons.empty()) {
+                    *regionBounds_ = regionBounds_->area() ? (*regionBounds_ | filePolys.bounds) : filePolys.bounds;
                 }
             }
             if (action == "include") {
-                regionFilter->add(filterPolys);
+                regionFilter_->add(filterPolys);
                 firstAction = false;
             } else if (action == "exclude") {
                 if (firstAction) {
                     OSN_LOG(info) << "User excluded regions first...automatically including the bounding box...";
-                    regionFilter->add(Polygon(LinearRing(cv::Rect(0, 0, bbox_.width, bbox_.height))));
+                    regionFilter_->add(Polygon(LinearRing(cv::Rect(0, 0, bbox_.width, bbox_.height))));
                 }
-                regionFilter->subtract(filterPolys);
+                regionFilter_->subtract(filterPolys);
                 firstAction = false;
             } else {
                 DG_ERROR_THROW("Unknown filtering action \"%s\"", action.c_str());
             }
         }
 
-        
-        auto subsetFilter = SubsetRegionFilter::create("regionFilter");
-        subsetFilter->attr("regionFilter") = regionFilter;
+        filterFiles_.clear();
+        duration<double> filterTime = high_resolution_clock::now() - startTime;
+        OSN_LOG(info) << "Subset filter initialized in " << filterTime.count() << " s";
+    }
+}
 
-        return subsetFilter;
+void OpenSpaceNet::readRegionFiles()
+{
+    // Every file is read once, even if it is used by several actions, and the files are read
+    // in parallel
+    for (const auto& filterAction : args_.filterDefinition) {
+        for (const auto& filterFile : filterAction.second) {
+            if (!filterFiles_.count(filterFile)) {
+                filterFiles_[filterFile] = async(std::launch::async, &OpenSpaceNet::readFilterPolygons, this,
+                                                 filterFile).share();
+            }
+        }
     }
+}
 
-    return nullptr;
+bool OpenSpaceNet::DetectionModel::isSegmentation() const
+{
+    return metadata->category() == "segmentation";
 }
 
-Detector::Ptr OpenSpaceNet::initDetector()
+// Returns the peak resident memory of the process
+static size_t peakMemory()
 {
-    auto model = Model::create(*args_.modelPackage, !args_.useCpu, args_.maxUtilization / 100);
-    args_.modelPackage.reset();
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+
+    // Linux reports the peak in kilobytes
+    return (size_t) usage.ru_maxrss * 1024;
+}
 
-    metadata_ = model->metadata().clone();
-    modelAspectRatio_ = (float) metadata_->modelSize().height / metadata_->modelSize().width;
-    float confidence = args_.confidence / 100;
+// Returns the percent of the GPU memory that one loaded model may use. Every model has a replica for
+// every inference worker, and a cascade model is loaded next to them, all on the same GPU.
+static float modelUtilization(const OpenSpaceNetArgs& args)
+{
+    if(args.useCpu) {
+        return args.maxUtilization;
+    }
 
-    if(!args_.windowSize.empty()) {
-        primaryWindowSize_ = { args_.windowSize[0], (int) roundf(modelAspectRatio_ * args_.windowSize[0]) };
-    } else if (args_.resampledSize) {
-        primaryWindowSize_ = { *args_.resampledSize, (int) roundf(modelAspectRatio_ * (*args_.resampledSize)) };
-    } else {
-        primaryWindowSize_ = metadata_->modelSize();
+    auto loadedModels = (int) args.modelPaths.size() * args.inferenceWorkers;
+    if(args.cascade && !args.cascadeModelPath.empty()) {
+        ++loadedModels;
     }
 
-    if(!args_.windowStep.empty()) {
-        primaryWindowStep_ = {args_.windowStep[0], (int) roundf(modelAspectRatio_ * args_.windowStep[0])};
-    } else {
-        primaryWindowStep_ = model->defaultStep(primaryWindowSize_);
+    auto utilization = args.maxUtilization / std::max(loadedModels, 1);
+    DG_CHECK(utilization >= MIN_REPLICA_UTILIZATION,
+             "%d loaded models can not share %g%% of the GPU memory, use fewer models or workers, or --cpu",
+             loadedModels, args.maxUtilization);
+    return utilization;
+}
+
+void OpenSpaceNet::initModels()
+{
+    // Every inference worker gets its own replica of each model
+    vector<vector<Model::Ptr>> replicas;
+    if(presetModels_.empty()) {
+        // The models and their replicas share the GPU, so each of them may only use its part of the memory
+        auto utilization = modelUtilization(args_);
+
+        for(const auto& modelPath : args_.modelPaths) {
+            auto startTime = high_resolution_clock::now();
+
+            // Each package is read just before its models are created and released right after, so
+            // only one package is in memory next to the loaded models
+            GbdxModelReader modelReader(modelPath);
+            auto modelPackage = modelReader.readModel();
+            DG_CHECK(modelPackage, "Unable to open the model package %s", modelPath.c_str());
+            presetModels_.push_back(Model::create(*modelPackage, !args_.useCpu, utilization / 100));
+
+            vector<Model::Ptr> modelReplicas;
+            for(int i = 1; i < args_.inferenceWorkers; ++i) {
+                modelReplicas.push_back(Model::create(*modelPackage, !args_.useCpu, utilization / 100));
+            }
+            replicas.push_back(move(modelReplicas));
+
+            auto name = modelPackage->metadata().name();
+            modelPackage.reset();
+
+            duration<double> loadTime = high_resolution_clock::now() - startTime;
+            OSN_LOG(info) << "Model " << name << " loaded in " << loadTime.count() << " s";
+        }
+
+        OSN_LOG(info) << "Peak memory use after loading the models is " << prettyBytes(peakMemory());
+    }
+
+    DG_CHECK(!presetModels_.empty(), "No model specified");
+
+    models_.clear();
+    for(size_t i = 0; i < presetModels_.size(); ++i) {
+        auto& model = presetModels_[i];
+
+        DetectionModel detectionModel;
+        detectionModel.model = model;
+        detectionModel.replicas.push_back(model);
+        if(i < replicas.size()) {
+            detectionModel.replicas.insert(detectionModel.replicas.end(), replicas[i].begin(), replicas[i].end());
+        }
+        detectionModel.metadata = model->metadata().clone();
+
+        auto& metadata = *detectionModel.metadata;
+        float aspectRatio = (float) metadata.modelSize().height / metadata.modelSize().width;
+        detectionModel.aspectRatio = aspectRatio;
+
+        if(!args_.windowSize.empty()) {
+            detectionModel.primaryWindowSize = { args_.windowSize[0], (int) roundf(aspectRatio * args_.windowSize[0]) };
+        } else if (args_.resampledSize) {
+            detectionModel.primaryWindowSize = { *args_.resampledSize, (int) roundf(aspectRatio * (*args_.resampledSize)) };
+        } else {
+            detectionModel.primaryWindowSize = metadata.modelSize();
+        }
+
+        if(!args_.windowStep.empty()) {
+            detectionModel.primaryWindowStep = {args_.windowStep[0], (int) roundf(aspectRatio * args_.windowStep[0])};
+        } else {
+            detectionModel.primaryWindowStep = model->defaultStep(detectionModel.primaryWindowSize);
+        }
+
+        DG_CHECK(!args_.resampledSize || *args_.resampledSize <= metadata.modelSize().width,
+                 "Argument --resample-size (size: %d) does not fit within the model (width: %d).",
+                 *args_.resampledSize, metadata.modelSize().width)
+
+        if (!args_.resampledSize) {
+            for (auto c : args_.windowSize) {
+                DG_CHECK(c <= metadata.modelSize().width,
+                         "Argument --window-size contains a size that does not fit within the model (width: %d).",
+                         metadata.modelSize().width)
+            }
+        }
+
+        if(detectionModel.isSegmentation()) {
+            for(const auto& replica : detectionModel.replicas) {
+                initSegmentation(replica);
+            }
+        }
+
+        // The model name is used to tell apart the outputs of multiple models
+        string name;
+        for(char c : metadata.name()) {
+            name += std::isalnum((unsigned char) c) ? (char) std::tolower((unsigned char) c) : '_';
+        }
+        if(name.empty()) {
+            name = "model";
+        }
+
+        detectionModel.name = name;
+        for(int suffix = 2; std::any_of(models_.begin(), models_.end(),
+                                        [&detectionModel](const DetectionModel& m) { return m.name == detectionModel.name; }); ++suffix) {
+            detectionModel.name = name + "_" + lexical_cast<string>(suffix);
+        }
+
+        printModel(detectionModel);
+        models_.push_back(move(detectionModel));
+    }
+
+    // The model packages are only read here, so the raster to polygon options are checked against
+    // the model categories once the models are loaded
+    if(std::none_of(models_.begin(), models_.end(), [](const DetectionModel& m) { return m.isSegmentation(); })) {
+        OpenSpaceNetArgs defaults;
+        if(args_.method != defaults.method || args_.epsilon != defaults.epsilon || args_.minArea != defaults.minArea) {
+            OSN_LOG(warning) << "Arguments --r2p-method, --r2p-accuracy and --r2p-min-area are ignored when no input "
+                                "model is a segmentation model.";
+        }
+    }
+}
+
+void OpenSpaceNet::initCascadeModels()
+{
+    if(!cascadeModels_.empty()) {
+        return;
     }
 
-    DG_CHECK(!args_.resampledSize || *args_.resampledSize <= metadata_->modelSize().width,
-             "Argument --resample-size (size: %d) does not fit within the model (width: %d).",
-             *args_.resampledSize, metadata_->modelSize().width)
+    vector<Model::Ptr> gatingModels;
+    if(!args_.cascadeModelPath.empty()) {
+        GbdxModelReader modelReader(args_.cascadeModelPath);
+        auto modelPackage = modelReader.readModel();
+        DG_CHECK(modelPackage, "Unable to open the model package %s", args_.cascadeModelPath.c_str());
+        gatingModels.push_back(Model::create(*modelPackage, !args_.useCpu, modelUtilization(args_) / 100));
+    } else {
+        for(const auto& model : models_) {
+            gatingModels.push_back(model.model);
+        }
+    }
 
-    if (!args_.resampledSize) {
-        for (auto c : args_.windowSize) {
-            DG_CHECK(c <= metadata_->modelSize().width,
-                     "Argument --window-size contains a size that does not fit within the model (width: %d).",
-                     metadata_->modelSize().width)
+    // The cascade pass runs only the model size windows, on a coarse grid
+    for(const auto& model : gatingModels) {
+        DetectionModel cascadeModel;
+        cascadeModel.model = model;
+        cascadeModel.replicas.push_back(model);
+        cascadeModel.metadata = model->metadata().clone();
+        cascadeModel.cascade = true;
+
+        const auto& metadata = *cascadeModel.metadata;
+        cascadeModel.aspectRatio = (float) metadata.modelSize().height / metadata.modelSize().width;
+        cascadeModel.primaryWindowSize = metadata.modelSize();
+        if(args_.cascadeStep > 0) {
+            cascadeModel.primaryWindowStep = { args_.cascadeStep, (int) roundf(cascadeModel.aspectRatio * args_.cascadeStep) };
+        } else {
+            cascadeModel.primaryWindowStep = { metadata.modelSize().width, metadata.modelSize().height };
         }
+        cascadeModel.name = "cascade_" + lexical_cast<string>(cascadeModels_.size());
+
+        cascadeModels_.push_back(move(cascadeModel));
     }
+}
 
+Detector::Ptr OpenSpaceNet::initDetector(const DetectionModel& model, size_t replica)
+{
     Detector::Ptr detectorNode;
-    if(metadata_->category() == "segmentation") {
-        initSegmentation(model);
+    if(model.isSegmentation()) {
         detectorNode = deepcore::classification::node::PolyDetector::create("detector");
     } else {
         detectorNode = deepcore::classification::node::BoxDetector::create("detector");
     }
 
-    detectorNode->attr("model") = model;
-    detectorNode->attr("confidence") = confidence;
+    detectorNode->attr("model") = model.replicas[replica];
+    detectorNode->attr("confidence") = (model.cascade ? args_.cascadeConfidence : args_.confidence) / 100;
+
+    // All windows are resampled to the model size by the sliding window, so a batch never mixes window sizes
+    if(args_.batchSize > 0) {
+        detectorNode->attr("batchSize") = args_.batchSize;
+    }
     return detectorNode;
 }
 
@@ -517,16 +1786,17 @@ void OpenSpaceNet::initSegmentation(Model::Ptr model)
     segmentation->setRasterToPolygon(make_unique<RasterToPolygonDP>(args_.method, args_.epsilon, args_.minArea));
 }
 
-dg::deepcore::imagery::node::SlidingWindow::Ptr OpenSpaceNet::initSlidingWindow()
+dg::deepcore::imagery::node::SlidingWindow::Ptr OpenSpaceNet::initSlidingWindow(const DetectionModel& model,
+                                                                                const cv::Rect& aoi)
 {
     auto slidingWindow = dg::deepcore::imagery::node::SlidingWindow::create("slidingWindow");
     auto resampledSize = args_.resampledSize ?
-                         cv::Size {*args_.resampledSize, (int) roundf(modelAspectRatio_ * (*args_.resampledSize))} :
-                         metadata_->modelSize();
-    auto windowSizes = calcWindows();
+                         cv::Size {*args_.resampledSize, (int) roundf(model.aspectRatio * (*args_.resampledSize))} :
+                         model.metadata->modelSize();
+    auto windowSizes = calcWindows(model);
     slidingWindow->attr("windowSizes") = windowSizes;
     slidingWindow->attr("resampledSize") = resampledSize;
-    slidingWindow->attr("aoi") = bbox_;
+    slidingWindow->attr("aoi") = aoi;
     slidingWindow->attr("bufferSize") = args_.maxCacheSize / 2;
 
     return slidingWindow;
@@ -556,10 +1826,11 @@ LabelFilter::Ptr OpenSpaceNet::initLabelFilter(bool isSegmentation)
     return labelFilter;
 }
 
-PredictionToFeature::Ptr OpenSpaceNet::initPredictionToFeature()
+PredictionToFeature::Ptr OpenSpaceNet::initPredictionToFeature(const Pass& pass)
 {
+    // A pass that is merged later writes polygons, so that the merge can suppress them
     auto predictionToFeature = PredictionToFeature::create("predToFeature");
-    predictionToFeature->attr("geometryType") = args_.geometryType;
+    predictionToFeature->attr("geometryType") = pass.outputDir.empty() ? args_.geometryType : GeometryType::POLYGON;
     predictionToFeature->attr("pixelToProj") = pixelToProj_;
     predictionToFeature->attr("topNName") = "top_five";
     predictionToFeature->attr("topNCategories") = 5;
@@ -593,10 +1864,10 @@ WfsFeatureFieldExtractor::Ptr OpenSpaceNet::initWfs()
         string baseUrl;
         if(args_.dgcsCatalogID) {
             OSN_LOG(info) << "Connecting to DGCS web feature service...";
-            baseUrl = "https://services.digitalglobe.com/catalogservice/wfsaccess";
+            baseUrl = "https://" DGCS_HOST "/catalogservice/wfsaccess";
         } else if (args_.evwhsCatalogID) {
             OSN_LOG(info) << "Connecting to EVWHS web feature service...";
-            baseUrl = Url("https://evwhs.digitalglobe.com/catalogservice/wfsaccess");
+            baseUrl = Url("https://" EVWHS_HOST "/catalogservice/wfsaccess");
         }
 
         auto wfsCreds = args_.wfsCredentials;
@@ -636,7 +1907,7 @@ WfsFeatureFieldExtractor::Ptr OpenSpaceNet::initWfs()
     return nullptr;
 }
 
-FileFeatureSink::Ptr OpenSpaceNet::initFeatureSink()
+FileFeatureSink::Ptr OpenSpaceNet::initFeatureSink(const DetectionModel& model, const Pass& pass)
 {
     FieldDefinitions definitions = {
             { FieldType::STRING, "top_cat", 50 },
@@ -659,33 +1930,48 @@ FileFeatureSink::Ptr OpenSpaceNet::initFeatureSink()
         definitions.emplace_back(FieldType::STRING, args_.extraFields[i]);
     }
 
-    VectorOpenMode openMode = args_.append ? APPEND : OVERWRITE;
+    string outputPath, layerName, outputFormat = args_.outputFormat;
+    if(pass.outputDir.empty()) {
+        outputFor(model, outputPath, layerName);
+    } else {
+        // The cascade pass output is only read back for the envelopes of its features
+        outputFormat = pass.models ? "geojson" : passFormat(args_.outputFormat);
+        outputPath = passOutput(pass.outputDir, model.name, outputFormat);
+        layerName = model.name;
+    }
 
     auto featureSink = FileFeatureSink::create("featureSink");
     featureSink->attr("spatialReference") = imageSr_;
     featureSink->attr("outputSpatialReference") = sr_;
-    featureSink->attr("geometryType") = args_.geometryType;
-    featureSink->attr("path") = args_.outputPath;
-    featureSink->attr("layerName") = args_.layerName;
-    featureSink->attr("outputFormat") = args_.outputFormat;
-    featureSink->attr("openMode") = openMode;
+    featureSink->attr("geometryType") = pass.outputDir.empty() ? args_.geometryType : GeometryType::POLYGON;
+    featureSink->attr("path") = outputPath;
+    featureSink->attr("layerName") = layerName;
+    featureSink->attr("outputFormat") = outputFormat;
+    featureSink->attr("openMode") = pass.openMode;
     featureSink->attr("fieldDefinitions") = definitions;
 
     return featureSink;
 }
 
-void OpenSpaceNet::printModel()
+void OpenSpaceNet::printModel(const DetectionModel& model)
 {
     skipLine();
 
-    OSN_LOG(info) << "Model Name: " << metadata_->name()
-                  << "; Version: " << metadata_->version()
-                  << "; Created: " << to_simple_string(from_time_t(metadata_->timeCreated()));
-    OSN_LOG(info) << "Description: " << metadata_->description();
-    OSN_LOG(info) << "Dimensions (pixels): " << metadata_->modelSize()
-                  << "; Color Mode: " << metadata_->colorMode();
-    OSN_LOG(info) << "Bounding box (lat/lon): " << metadata_->boundingBox();
-    OSN_LOG(info) << "Labels: " << join(metadata_->labels(), ", ");
+    OSN_LOG(info) << "Model Name: " << model.metadata->name()
+                  << "; Version: " << model.metadata->version()
+                  << "; Created: " << to_simple_string(from_time_t(model.metadata->timeCreated()));
+    OSN_LOG(info) << "Description: " << model.metadata->description();
+    OSN_LOG(info) << "Dimensions (pixels): " << model.metadata->modelSize()
+                  << "; Color Mode: " << model.metadata->colorMode();
+    OSN_LOG(info) << "Bounding box (lat/lon): " << model.metadata->boundingBox();
+    OSN_LOG(info) << "Labels: " << join(model.metadata->labels(), ", ");
+
+    // Overlapping windows pass the same pixels through the model several times
+    double coverage = 0;
+    for(const auto& sizeStep : calcWindows(model)) {
+        coverage += (double) sizeStep.first.area() / (sizeStep.second.x * sizeStep.second.y);
+    }
+    OSN_LOG(info) << format("Window coverage: every pixel is processed about %.1f times") % coverage;
 
     skipLine();
 }
@@ -697,8 +1983,12 @@ void OpenSpaceNet::skipLine() const
     }
 }
 
-SizeSteps OpenSpaceNet::calcWindows() const
+SizeSteps OpenSpaceNet::calcWindows(const DetectionModel& model) const
 {
+    if(model.cascade) {
+        return { { model.primaryWindowSize, model.primaryWindowStep } };
+    }
+
     DG_CHECK(args_.windowSize.size() < 2 || args_.windowStep.size() < 2 ||
              args_.windowSize.size() == args_.windowStep.size(),
              "Number of window sizes and window steps must match.");
@@ -708,24 +1998,259 @@ SizeSteps OpenSpaceNet::calcWindows() const
         for(const auto& c : boost::combine(args_.windowSize, args_.windowStep)) {
             int windowSize, windowStep;
             boost::tie(windowSize, windowStep) = c;
-            ret.emplace_back(cv::Size {windowSize, (int) roundf(modelAspectRatio_ * windowSize)},
-                             cv::Point {windowStep, (int) roundf(modelAspectRatio_ * windowStep)});
+            ret.emplace_back(cv::Size {windowSize, (int) roundf(model.aspectRatio * windowSize)},
+                             cv::Point {windowStep, (int) roundf(model.aspectRatio * windowStep)});
         }
         return ret;
     } else if (args_.windowSize.size() > 1) {
         SizeSteps ret;
         for(const auto& c : args_.windowSize) {
-            ret.emplace_back(cv::Size { c, (int) roundf(modelAspectRatio_ * c) }, primaryWindowStep_);
+            ret.emplace_back(cv::Size { c, (int) roundf(model.aspectRatio * c) }, model.primaryWindowStep);
         }
         return ret;
     } else if (args_.windowStep.size() > 1) {
         SizeSteps ret;
         for(const auto& c : args_.windowStep) {
-            ret.emplace_back(primaryWindowSize_, cv::Point { c, (int) roundf(modelAspectRatio_ * c) });
+            ret.emplace_back(model.primaryWindowSize, cv::Point { c, (int) roundf(model.aspectRatio * c) });
         }
         return ret;
     } else {
-        return { { primaryWindowSize_, primaryWindowStep_ } };
+        return { { model.primaryWindowSize, model.primaryWindowStep } };
+    }
+}
+
+static int greatestCommonDivisor(int a, int b)
+{
+    while(b) {
+        auto r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+OpenSpaceNet::StripGrid OpenSpaceNet::calcStripGrid() const
+{
+    // The AOI is split along its longer side
+    return calcStripGrid(bbox_.height >= bbox_.width);
+}
+
+OpenSpaceNet::StripGrid OpenSpaceNet::calcStripGrid(bool splitRows) const
+{
+    // Strip borders are placed on a grid that is a multiple of every window step, so that each
+    // window origin belongs to exactly one strip
+    StripGrid grid;
+    grid.splitRows = splitRows;
+    grid.length = grid.splitRows ? bbox_.height : bbox_.width;
+
+    for(const auto& model : models_) {
+        for(const auto& sizeStep : calcWindows(model)) {
+            int size = grid.splitRows ? sizeStep.first.height : sizeStep.first.width;
+            int step = grid.splitRows ? sizeStep.second.y : sizeStep.second.x;
+            grid.cellSize = grid.cellSize / greatestCommonDivisor(grid.cellSize, step) * step;
+            grid.windows.emplace_back(size, step);
+        }
+    }
+
+    grid.cells = (grid.length + grid.cellSize - 1) / grid.cellSize;
+    return grid;
+}
+
+cv::Rect OpenSpaceNet::calcStrip(const StripGrid& grid, int beginCell, int endCell) const
+{
+    int begin = beginCell * grid.cellSize;
+    int end = endCell * grid.cellSize;
+
+    // Every strip but the last is extended past its last window origin far enough to contain the
+    // largest window. The origins of smaller windows in the extension belong to the next strip,
+    // see calcStripOrigins().
+    int extent = grid.length;
+    if(endCell < grid.cells) {
+        extent = end;
+        for(const auto& window : grid.windows) {
+            extent = std::max(extent, end - window.second + window.first);
+        }
+        extent = std::min(extent, grid.length);
+    }
+
+    auto strip = bbox_;
+    if(grid.splitRows) {
+        strip.y += begin;
+        strip.height = extent - begin;
+    } else {
+        strip.x += begin;
+        strip.width = extent - begin;
+    }
+
+    return strip;
+}
+
+cv::Rect OpenSpaceNet::calcStripOrigins(const StripGrid& grid, int beginCell, int endCell) const
+{
+    // A strip owns the window origins in its cells, of every window size of every model. The
+    // windows that extend into the strip from the previous one belong to that strip. The area
+    // ends half a cell before the next strip, so that it does not mark the first cell of the next
+    // strip in the origin filter.
+    int begin = beginCell * grid.cellSize;
+    int end = endCell < grid.cells ? endCell * grid.cellSize - grid.cellSize / 2 : grid.length;
+
+    auto origins = bbox_;
+    if(grid.splitRows) {
+        origins.y += begin;
+        origins.height = end - begin;
+    } else {
+        origins.x += begin;
+        origins.width = end - begin;
+    }
+
+    return origins;
+}
+
+int OpenSpaceNet::calcSuperTileSize() const
+{
+    if(!args_.maxCacheSize || !pixelBytes_) {
+        OSN_LOG(info) << "The raster cache size is not limited, processing without super-tiles";
+        return 0;
+    }
+
+    // Which blocks the sliding windows read next is known up front: they walk the AOI row by row,
+    // and moving to the next row of windows only needs the blocks of one more window step. No
+    // block has to be read twice if the cache holds the blocks of a window row and a step.
+    int bandHeight = 0;
+    int maxWidth = 0;
+    for(const auto& model : models_) {
+        for(const auto& sizeStep : calcWindows(model)) {
+            bandHeight = std::max(bandHeight, sizeStep.first.height + sizeStep.second.y);
+            maxWidth = std::max(maxWidth, sizeStep.first.width);
+        }
+    }
+
+    auto blockColumnBytes = (size_t) (bandHeight / blockSize_.height + 2) * blockSize_.width * blockSize_.height * pixelBytes_;
+    auto cacheSize = args_.maxCacheSize / 2;
+    auto blocks = (int) (cacheSize / blockColumnBytes);
+    if(blocks >= bbox_.width / blockSize_.width + 2) {
+        OSN_LOG(info) << "A row of windows across the area of interest fits in the raster cache, processing without super-tiles";
+        return 0;
+    }
+
+    // Otherwise the AOI is processed in super-tiles narrow enough for their window rows to fit
+    auto size = std::max((blocks - 2) * blockSize_.width, 2 * maxWidth);
+    if(blocks - 2 < (2 * maxWidth + blockSize_.width - 1) / blockSize_.width) {
+        OSN_LOG(warning) << "The raster cache is too small to hold a row of windows, some blocks will be read more than once";
+    }
+
+    OSN_LOG(info) << "A row of windows across the area of interest does not fit in the raster cache, processing in super-tiles of "
+                  << size << " pixels";
+    return size;
+}
+
+bool OpenSpaceNet::clipToRegions(cv::Rect& aoi) const
+{
+    if(!regionBounds_) {
+        return true;
+    }
+
+    // Windows that touch the region bounds are kept. The clipped area starts on a multiple of
+    // every window step from the original one, so the windows stay on the same grid.
+    cv::Size maxSize;
+    cv::Point cellSize(1, 1);
+    for(const auto& model : models_) {
+        for(const auto& sizeStep : calcWindows(model)) {
+            maxSize.width = std::max(maxSize.width, sizeStep.first.width);
+            maxSize.height = std::max(maxSize.height, sizeStep.first.height);
+            cellSize.x = cellSize.x / greatestCommonDivisor(cellSize.x, sizeStep.second.x) * sizeStep.second.x;
+            cellSize.y = cellSize.y / greatestCommonDivisor(cellSize.y, sizeStep.second.y) * sizeStep.second.y;
+        }
+    }
+
+    auto bounds = *regionBounds_ & aoi;
+    if(!bounds.area()) {
+        // Nothing in the area passes the filter. The first window is kept, so that the graph still
+        // runs and creates the outputs, but almost nothing is read.
+        aoi = cv::Rect(aoi.tl(), cv::Size(std::min(maxSize.width, aoi.width), std::min(maxSize.height, aoi.height)));
+        return false;
+    }
+
+    int left = std::max(bounds.x - maxSize.width + 1 - aoi.x, 0) / cellSize.x * cellSize.x;
+    int top = std::max(bounds.y - maxSize.height + 1 - aoi.y, 0) / cellSize.y * cellSize.y;
+    int right = std::min(bounds.x + bounds.width + maxSize.width - 1, aoi.x + aoi.width);
+    int bottom = std::min(bounds.y + bounds.height + maxSize.height - 1, aoi.y + aoi.height);
+    aoi = cv::Rect(cv::Point(aoi.x + left, aoi.y + top), cv::Point(right, bottom));
+    return true;
+}
+
+string OpenSpaceNet::journalPath() const
+{
+    if(args_.outputFormat == "postgis" || args_.outputFormat == "elasticsearch") {
+        return args_.layerName + ".checkpoint";
+    }
+
+    return args_.outputPath + ".checkpoint";
+}
+
+std::ofstream OpenSpaceNet::openJournal(int strips, std::set<int>& done) const
+{
+    // The journal header identifies the area and the strips, so that a journal is never applied
+    // to a run with different settings
+    std::ostringstream header;
+    header << "aoi " << bbox_.x << " " << bbox_.y << " " << bbox_.width << " " << bbox_.height << "\n"
+           << "shard " << args_.shardIndex << "/" << args_.shardCount << "\n"
+           << "strips " << strips << "\n";
+    for(const auto& model : models_) {
+        header << "model " << model.name << "\n";
+        for(const auto& sizeStep : calcWindows(model)) {
+            header << "window " << sizeStep.first << " " << sizeStep.second << "\n";
+        }
+    }
+
+    auto path = journalPath();
+    if(args_.resume && boost::filesystem::exists(path)) {
+        std::ifstream ifs(path);
+        DG_CHECK(ifs.is_open(), "Unable to open the checkpoint journal %s", path.c_str());
+
+        std::ostringstream journalHeader;
+        string line;
+        while(std::getline(ifs, line)) {
+            if(boost::starts_with(line, "done ")) {
+                done.insert(lexical_cast<int>(line.substr(5)));
+            } else {
+                journalHeader << line << "\n";
+            }
+        }
+
+        DG_CHECK(journalHeader.str() == header.str(),
+                 "The checkpoint journal %s was written with different processing settings", path.c_str());
+
+        std::ofstream journal(path, std::ios::app);
+        DG_CHECK(journal.is_open(), "Unable to open the checkpoint journal %s", path.c_str());
+        return journal;
+    }
+
+    std::ofstream journal(path, std::ios::trunc);
+    DG_CHECK(journal.is_open(), "Unable to create the checkpoint journal %s", path.c_str());
+    journal << header.str() << std::flush;
+    return journal;
+}
+
+void OpenSpaceNet::outputFor(const DetectionModel& model, string& outputPath, string& layerName) const
+{
+    outputPath = args_.outputPath;
+    layerName = args_.layerName;
+    if(models_.size() < 2) {
+        return;
+    }
+
+    // With several models, every model writes its own output named after the model
+    if(args_.outputFormat == "postgis" || args_.outputFormat == "elasticsearch") {
+        layerName += "_" + model.name;
+        return;
+    }
+
+    path output(args_.outputPath);
+    auto stem = output.stem().string() + "_" + model.name;
+    outputPath = (output.parent_path() / (stem + output.extension().string())).string();
+    if(args_.outputFormat == "shp") {
+        layerName = stem;
     }
 }
 
@@ -0,0 +1,153 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "OpenSpaceNetArgs.h"
+
+#include <boost/make_unique.hpp>
+#include <utility/Logging.h>
+
+namespace dg { namespace osn {
+
+using boost::make_unique;
+
+OpenSpaceNetArgs OpenSpaceNetArgs::copy() const
+{
+    OpenSpaceNetArgs args;
+
+    args.action = action;
+    args.source = source;
+    args.image = image;
+    if(bbox) {
+        args.bbox = make_unique<cv::Rect2d>(*bbox);
+    }
+
+    args.token = token;
+    args.credentials = credentials;
+    args.zoom = zoom;
+    args.maxConnections = maxConnections;
+    args.adaptiveConnections = adaptiveConnections;
+    args.adaptiveStrips = adaptiveStrips;
+    args.mapId = mapId;
+    args.url = url;
+    args.useTiles = useTiles;
+    args.tileCacheDir = tileCacheDir;
+    args.tileCacheSize = tileCacheSize;
+
+    args.geometryType = geometryType;
+    args.outputFormat = outputFormat;
+    args.outputPath = outputPath;
+    args.layerName = layerName;
+    args.producerInfo = producerInfo;
+    args.dgcsCatalogID = dgcsCatalogID;
+    args.evwhsCatalogID = evwhsCatalogID;
+    args.wfsCredentials = wfsCredentials;
+    args.append = append;
+    args.extraFields = extraFields;
+
+    args.modelPaths = modelPaths;
+    args.useCpu = useCpu;
+    args.maxUtilization = maxUtilization;
+    args.windowSize = windowSize;
+    args.windowStep = windowStep;
+    if(resampledSize) {
+        args.resampledSize = make_unique<int>(*resampledSize);
+    }
+    args.maxCacheSize = maxCacheSize;
+    args.shardIndex = shardIndex;
+    args.shardCount = shardCount;
+    args.checkpointStrips = checkpointStrips;
+    args.resume = resume;
+    args.inferenceWorkers = inferenceWorkers;
+    args.batchSize = batchSize;
+    args.superTileSize = superTileSize;
+    args.autoSuperTile = autoSuperTile;
+
+    args.confidence = confidence;
+    args.nms = nms;
+    args.overlap = overlap;
+    args.includeLabels = includeLabels;
+    args.excludeLabels = excludeLabels;
+    args.filterDefinition = filterDefinition;
+
+    args.screen = screen;
+    args.screenMaxInvalid = screenMaxInvalid;
+    args.screenMinStdDev = screenMinStdDev;
+
+    args.cascade = cascade;
+    args.cascadeStep = cascadeStep;
+    args.cascadeConfidence = cascadeConfidence;
+    args.cascadeModelPath = cascadeModelPath;
+
+    args.method = method;
+    args.epsilon = epsilon;
+    args.minArea = minArea;
+
+    args.manifestPath = manifestPath;
+    for(const auto& item : batchItems) {
+        BatchItem itemCopy;
+        itemCopy.image = item.image;
+        if(item.bbox) {
+            itemCopy.bbox = make_unique<cv::Rect2d>(*item.bbox);
+        }
+        itemCopy.outputPath = item.outputPath;
+        itemCopy.layerName = item.layerName;
+        args.batchItems.push_back(std::move(itemCopy));
+    }
+
+    args.socketPath = socketPath;
+    args.maxModels = maxModels;
+    args.maxQueuedJobs = maxQueuedJobs;
+    args.maxClients = maxClients;
+
+    args.mergeInputs = mergeInputs;
+
+    args.quiet = quiet;
+    args.metricsPath = metricsPath;
+    args.tracePath = tracePath;
+
+    return args;
+}
+
+void OpenSpaceNetArgs::validate() const
+{
+    DG_CHECK(includeLabels.empty() || excludeLabels.empty(),
+             "Arguments --include-labels and --exclude-labels may not be specified at the same time");
+
+    DG_CHECK(inferenceWorkers > 0, "Argument --inference-workers must be at least 1");
+    DG_CHECK(shardCount > 0 && shardIndex >= 0 && shardIndex < shardCount,
+             "Invalid --shard parameter, INDEX must be between 0 and COUNT - 1");
+    DG_CHECK(superTileSize >= 0, "Argument --super-tile must be a positive size");
+    if(superTileSize || autoSuperTile) {
+        DG_CHECK(shardCount == 1 && !checkpointStrips && inferenceWorkers == 1,
+                 "Argument --super-tile may not be combined with --shard, --checkpoint or --inference-workers");
+    }
+    DG_CHECK(cascadeStep >= 0, "Argument --cascade must be a positive step");
+    DG_CHECK(screenMaxInvalid >= 0 && screenMaxInvalid <= 100, "Argument --screen-max-invalid must be between 0 and 100");
+    DG_CHECK(screenMinStdDev >= 0, "Argument --screen-min-stddev may not be negative");
+    if(screen && source > Source::LOCAL) {
+        OSN_LOG(warning) << "Argument --screen is ignored when using a map service";
+    }
+    if(inferenceWorkers > 1) {
+        DG_CHECK(!checkpointStrips, "Arguments --inference-workers and --checkpoint may not be specified at the same time");
+        DG_CHECK(outputFormat != "postgis" && outputFormat != "elasticsearch",
+                 "Argument --inference-workers is not supported with the %s output format", outputFormat.c_str());
+    }
+
+    DG_CHECK(windowSize.size() < 2 || windowStep.size() < 2 || windowSize.size() == windowStep.size(),
+             "Arguments --window-size and --window-step must match in length");
+}
+
+} } // namespace dg { namespace osn {
@@ -0,0 +1,561 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "OpenSpaceNetServer.h"
+#include "OpenSpaceNet.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/make_unique.hpp>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace dg { namespace osn {
+
+using namespace dg::deepcore::classification;
+
+using boost::filesystem::path;
+using boost::make_unique;
+using boost::to_lower_copy;
+using std::chrono::duration;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::condition_variable;
+using std::lock_guard;
+using std::make_shared;
+using std::map;
+using std::move;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+using std::thread;
+using std::unique_lock;
+using std::vector;
+
+// Minimum interval between two progress messages of the same job
+static const milliseconds PROGRESS_INTERVAL(500);
+
+// Write end of the pipe that wakes up the server when it receives a signal
+static int signalPipe = -1;
+
+static void onSignal(int)
+{
+    char signal = 0;
+    auto ret = write(signalPipe, &signal, 1);
+    (void) ret;
+}
+
+// Returns a message as a line of JSON
+static string toLine(const Json::Value& message)
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, message) + "\n";
+}
+
+struct OpenSpaceNetServer::Job
+{
+    int id = 0;
+    Json::Value request;
+
+    mutex messageMutex;
+    condition_variable changed;
+    std::deque<string> messages;
+    bool finished = false;
+
+    void post(Json::Value message, bool last = false)
+    {
+        message["id"] = id;
+        auto line = toLine(message);
+
+        lock_guard<mutex> lock(messageMutex);
+        messages.push_back(move(line));
+        finished |= last;
+        changed.notify_all();
+    }
+};
+
+static Json::Value statusMessage(const char* status)
+{
+    Json::Value message;
+    message["status"] = status;
+    return message;
+}
+
+static Source parseService(const string& service)
+{
+    auto lowerService = to_lower_copy(service);
+    if(lowerService == "dgcs") {
+        return Source::DGCS;
+    } else if(lowerService == "evwhs") {
+        return Source::EVWHS;
+    } else if(lowerService == "maps-api") {
+        return Source::MAPS_API;
+    } else if(lowerService == "tile-json") {
+        return Source::TILE_JSON;
+    }
+
+    DG_ERROR_THROW("Invalid service: %s", service.c_str());
+}
+
+static bool sendAll(int fd, const string& data)
+{
+    size_t sent = 0;
+    while(sent < data.size()) {
+        auto ret = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(ret <= 0) {
+            return false;
+        }
+        sent += ret;
+    }
+
+    return true;
+}
+
+// Returns the part of the GPU memory that one loaded model may use. The cached models and the cascade
+// model of a job share the GPU.
+static float modelUtilization(const OpenSpaceNetArgs& defaults)
+{
+    auto loadedModels = defaults.maxModels;
+    if(defaults.cascade && !defaults.cascadeModelPath.empty()) {
+        ++loadedModels;
+    }
+
+    return defaults.maxUtilization / loadedModels;
+}
+
+// Returns an output path of the server options with the job id added, e.g. metrics_3.json
+static string jobPath(const string& serverPath, int jobId)
+{
+    path jobPath(serverPath);
+    auto fileName = jobPath.stem().string() + "_" + std::to_string(jobId) + jobPath.extension().string();
+    return (jobPath.parent_path() / fileName).string();
+}
+
+OpenSpaceNetServer::OpenSpaceNetServer(OpenSpaceNetArgs&& defaults) :
+    defaults_(move(defaults)),
+    models_(defaults_.maxModels, !defaults_.useCpu, modelUtilization(defaults_) / 100)
+{
+    for(const auto& modelPath : defaults_.modelPaths) {
+        models_.get(modelPath);
+    }
+}
+
+OpenSpaceNetServer::~OpenSpaceNetServer()
+{
+    stop();
+
+    if(listenFd_ >= 0) {
+        close(listenFd_);
+        unlink(defaults_.socketPath.c_str());
+    }
+}
+
+void OpenSpaceNetServer::run()
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    DG_CHECK(defaults_.socketPath.size() < sizeof(address.sun_path), "Socket path is too long: %s",
+             defaults_.socketPath.c_str());
+    strncpy(address.sun_path, defaults_.socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    DG_CHECK(listenFd_ >= 0, "Unable to create a socket: %s", strerror(errno));
+
+    unlink(defaults_.socketPath.c_str());
+    DG_CHECK(bind(listenFd_, (sockaddr*) &address, sizeof(address)) == 0,
+             "Unable to bind to %s: %s", defaults_.socketPath.c_str(), strerror(errno));
+    DG_CHECK(listen(listenFd_, SOMAXCONN) == 0, "Unable to listen on %s: %s",
+             defaults_.socketPath.c_str(), strerror(errno));
+
+    // The signal handler only wakes up the accept loop, the server is stopped outside of it. Other
+    // system calls that the signal interrupts are restarted.
+    int pipeFds[2];
+    DG_CHECK(pipe(pipeFds) == 0, "Unable to create a pipe: %s", strerror(errno));
+    signalPipe = pipeFds[1];
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    struct sigaction oldInt, oldTerm;
+    sigaction(SIGINT, &action, &oldInt);
+    sigaction(SIGTERM, &action, &oldTerm);
+
+    OSN_LOG(info) << "Listening for jobs on " << defaults_.socketPath;
+
+    worker_ = thread(&OpenSpaceNetServer::processJobs, this);
+
+    std::exception_ptr error;
+    try {
+        for(;;) {
+            pollfd fds[2] = { { listenFd_, POLLIN, 0 }, { pipeFds[0], POLLIN, 0 } };
+            if(poll(fds, 2, -1) < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                DG_ERROR_THROW("Error waiting for connections: %s", strerror(errno));
+            }
+
+            if(fds[1].revents) {
+                OSN_LOG(info) << "Stopping the server, the running job is finished first...";
+                break;
+            }
+
+            if(fds[0].revents) {
+                acceptConnection();
+            }
+        }
+    } catch(...) {
+        error = std::current_exception();
+    }
+
+    // A second signal stops the process right away
+    sigaction(SIGINT, &oldInt, nullptr);
+    sigaction(SIGTERM, &oldTerm, nullptr);
+    stop();
+    signalPipe = -1;
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+
+    OSN_LOG(info) << "Server stopped";
+}
+
+void OpenSpaceNetServer::acceptConnection()
+{
+    int fd = accept(listenFd_, nullptr, nullptr);
+    if(fd < 0) {
+        if(errno == EINTR || errno == ECONNABORTED) {
+            return;
+        }
+        DG_ERROR_THROW("Error accepting a connection: %s", strerror(errno));
+    }
+
+    lock_guard<mutex> lock(connectionMutex_);
+    reapConnections();
+    if(connectionFds_.size() >= (size_t) defaults_.maxClients) {
+        auto message = statusMessage("failed");
+        message["error"] = "Too many clients";
+        sendAll(fd, toLine(message));
+        close(fd);
+        return;
+    }
+
+    connectionFds_.insert(fd);
+    thread connectionThread(&OpenSpaceNetServer::serveConnection, this, fd);
+    auto id = connectionThread.get_id();
+    connectionThreads_.emplace(id, move(connectionThread));
+}
+
+void OpenSpaceNetServer::reapConnections()
+{
+    // The threads of closed connections are joined as new connections come in
+    for(auto id : finishedThreads_) {
+        auto it = connectionThreads_.find(id);
+        if(it != connectionThreads_.end()) {
+            it->second.join();
+            connectionThreads_.erase(it);
+        }
+    }
+    finishedThreads_.clear();
+}
+
+void OpenSpaceNetServer::serveConnection(int fd)
+{
+    string buffer;
+    char data[4096];
+
+    for(;;) {
+        auto lineEnd = buffer.find('\n');
+        if(lineEnd == string::npos) {
+            auto received = recv(fd, data, sizeof(data), 0);
+            if(received <= 0) {
+                break;
+            }
+            buffer.append(data, received);
+            continue;
+        }
+
+        auto line = buffer.substr(0, lineEnd);
+        buffer.erase(0, lineEnd + 1);
+        boost::trim(line);
+        if(line.empty()) {
+            continue;
+        }
+
+        auto job = make_shared<Job>();
+
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        string errors;
+        if(!reader->parse(line.data(), line.data() + line.size(), &job->request, &errors) ||
+           !job->request.isObject()) {
+            auto message = statusMessage("failed");
+            message["error"] = "Invalid job request: " + errors;
+            job->post(message, true);
+        } else {
+            lock_guard<mutex> lock(queueMutex_);
+            job->id = nextJobId_++;
+            if(stop_) {
+                auto message = statusMessage("failed");
+                message["error"] = "The server is stopping";
+                job->post(message, true);
+            } else if(queue_.size() >= (size_t) defaults_.maxQueuedJobs) {
+                auto message = statusMessage("failed");
+                message["error"] = "Job queue is full";
+                job->post(message, true);
+            } else {
+                auto message = statusMessage("queued");
+                message["position"] = (Json::UInt64) queue_.size();
+                job->post(message);
+                queue_.push_back(job);
+                queueChanged_.notify_one();
+            }
+        }
+
+        // Stream the job status until it is finished
+        bool connected = true;
+        for(;;) {
+            unique_lock<mutex> lock(job->messageMutex);
+            job->changed.wait(lock, [&job] { return !job->messages.empty() || job->finished; });
+
+            auto messages = move(job->messages);
+            job->messages.clear();
+            bool finished = job->finished;
+            lock.unlock();
+
+            for(const auto& message : messages) {
+                connected = connected && sendAll(fd, message);
+            }
+
+            if(finished) {
+                break;
+            }
+        }
+
+        if(!connected) {
+            break;
+        }
+    }
+
+    lock_guard<mutex> lock(connectionMutex_);
+    connectionFds_.erase(fd);
+    close(fd);
+    finishedThreads_.push_back(std::this_thread::get_id());
+}
+
+void OpenSpaceNetServer::processJobs()
+{
+    for(;;) {
+        shared_ptr<Job> job;
+        {
+            unique_lock<mutex> lock(queueMutex_);
+            queueChanged_.wait(lock, [this] { return !queue_.empty() || stop_; });
+            if(stop_) {
+                return;
+            }
+            job = queue_.front();
+            queue_.pop_front();
+        }
+
+        processJob(*job);
+    }
+}
+
+void OpenSpaceNetServer::processJob(Job& job)
+{
+    OSN_LOG(info) << "Starting job " << job.id;
+    job.post(statusMessage("running"));
+
+    auto startTime = steady_clock::now();
+
+    try {
+        auto args = jobArgs(job.request, job.id);
+        vector<Model::Ptr> models;
+        for(const auto& modelPath : args.modelPaths) {
+            models.push_back(models_.get(modelPath));
+        }
+
+        OpenSpaceNet osn(move(args));
+        osn.setModels(move(models));
+
+        mutex progressMutex;
+        Json::Value progress = statusMessage("running");
+        auto lastUpdate = steady_clock::now();
+        osn.setProgressCallback([&] (const string& name, int64_t value) {
+            lock_guard<mutex> lock(progressMutex);
+            progress[name] = (Json::Int64) value;
+
+            auto now = steady_clock::now();
+            if(now - lastUpdate >= PROGRESS_INTERVAL) {
+                lastUpdate = now;
+                job.post(progress);
+            }
+        });
+
+        osn.process();
+
+        duration<double> elapsed = steady_clock::now() - startTime;
+        auto message = statusMessage("done");
+        message["features"] = progress.get("features", 0);
+        message["seconds"] = elapsed.count();
+        job.post(message, true);
+
+        OSN_LOG(info) << "Job " << job.id << " finished in " << elapsed.count() << " s";
+    } catch(const std::exception& e) {
+        OSN_LOG(error) << "Job " << job.id << " failed: " << e.what();
+
+        auto message = statusMessage("failed");
+        message["error"] = e.what();
+        job.post(message, true);
+    } catch(...) {
+        OSN_LOG(error) << "Job " << job.id << " failed: unknown error";
+
+        auto message = statusMessage("failed");
+        message["error"] = "Unknown error";
+        job.post(message, true);
+    }
+}
+
+void OpenSpaceNetServer::stop()
+{
+    // Jobs that have not started are failed, the running job is finished
+    {
+        lock_guard<mutex> lock(queueMutex_);
+        stop_ = true;
+        for(const auto& job : queue_) {
+            auto message = statusMessage("failed");
+            message["error"] = "The server is stopping";
+            job->post(message, true);
+        }
+        queue_.clear();
+        queueChanged_.notify_all();
+    }
+
+    if(worker_.joinable()) {
+        worker_.join();
+    }
+
+    // The clients receive the status of their last job before their connections are closed
+    map<thread::id, thread> connectionThreads;
+    {
+        lock_guard<mutex> lock(connectionMutex_);
+        for(auto fd : connectionFds_) {
+            ::shutdown(fd, SHUT_RD);
+        }
+        connectionThreads.swap(connectionThreads_);
+    }
+
+    for(auto& connectionThread : connectionThreads) {
+        connectionThread.second.join();
+    }
+
+    lock_guard<mutex> lock(connectionMutex_);
+    finishedThreads_.clear();
+}
+
+OpenSpaceNetArgs OpenSpaceNetServer::jobArgs(const Json::Value& request, int jobId) const
+{
+    // Every option given to the server is a default for the job
+    auto args = defaults_.copy();
+    args.action = Action::DETECT;
+
+    // A job loads only its cascade model, within the part of the GPU memory of one cached model
+    args.maxUtilization = modelUtilization(defaults_);
+
+    // Jobs must not overwrite each other's metrics and traces
+    if(!args.metricsPath.empty()) {
+        args.metricsPath = jobPath(args.metricsPath, jobId);
+    }
+    if(!args.tracePath.empty()) {
+        args.tracePath = jobPath(args.tracePath, jobId);
+    }
+
+    // Job settings
+    if(request.isMember("image")) {
+        args.source = Source::LOCAL;
+        args.image = request["image"].asString();
+    } else if(request.isMember("service")) {
+        args.source = parseService(request["service"].asString());
+    } else {
+        DG_ERROR_THROW("Either \"image\" or \"service\" must be specified");
+    }
+
+    if(request.isMember("bbox")) {
+        const auto& bbox = request["bbox"];
+        DG_CHECK(bbox.isArray() && bbox.size() == 4, "\"bbox\" must be an array of 4 numbers: west, south, east, north");
+        args.bbox = make_unique<cv::Rect2d>(cv::Point2d(bbox[0].asDouble(), bbox[1].asDouble()),
+                                            cv::Point2d(bbox[2].asDouble(), bbox[3].asDouble()));
+    } else {
+        DG_CHECK(args.source == Source::LOCAL || args.bbox, "\"bbox\" is required for map service jobs");
+    }
+
+    args.token = request.get("token", args.token).asString();
+    args.credentials = request.get("credentials", args.credentials).asString();
+    args.url = request.get("url", args.url).asString();
+    args.zoom = request.get("zoom", args.zoom).asInt();
+    args.mapId = request.get("mapId", args.mapId).asString();
+    if(request.isMember("model")) {
+        const auto& model = request["model"];
+        args.modelPaths.clear();
+        if(model.isArray()) {
+            for(const auto& modelPath : model) {
+                args.modelPaths.push_back(modelPath.asString());
+            }
+        } else {
+            args.modelPaths.push_back(model.asString());
+        }
+    }
+    args.outputPath = request.get("output", "").asString();
+    args.outputFormat = to_lower_copy(request.get("format", args.outputFormat).asString());
+    args.layerName = request.get("layer", args.layerName).asString();
+    args.append = request.get("append", args.append).asBool();
+    args.confidence = request.get("confidence", args.confidence).asFloat();
+
+    if(request.isMember("nms")) {
+        const auto& nms = request["nms"];
+        args.nms = nms.isBool() ? nms.asBool() : true;
+        if(nms.isNumeric()) {
+            args.overlap = nms.asFloat();
+        }
+    }
+
+    DG_CHECK(!args.modelPaths.empty(), "\"model\" must be specified");
+    DG_CHECK(!args.outputPath.empty(), "\"output\" must be specified");
+    args.validate();
+
+    if(args.outputFormat == "shp") {
+        args.layerName = path(args.outputPath).stem().filename().string();
+    } else if(args.layerName.empty()) {
+        args.layerName = "osndetects";
+    }
+
+    return args;
+}
+
+} } // namespace dg { namespace osn {
@@ -0,0 +1,351 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "ShardMerger.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cmath>
+#include <gdal_priv.h>
+#include <map>
+#include <ogrsf_frmts.h>
+#include <unordered_map>
+#include <utility/Logging.h>
+
+namespace dg { namespace osn {
+
+using boost::filesystem::exists;
+using std::map;
+using std::move;
+using std::pair;
+using std::string;
+using std::unique_ptr;
+using std::unordered_map;
+using std::vector;
+
+static const char* driverName(const string& format)
+{
+    if(format == "shp") {
+        return "ESRI Shapefile";
+    } else if(format == "geojson") {
+        return "GeoJSON";
+    } else if(format == "kml") {
+        return "KML";
+    } else if(format == "csv") {
+        return "CSV";
+    } else if(format == "sqlite") {
+        return "SQLite";
+    } else if(format == "postgis") {
+        return "PostgreSQL";
+    } else if(format == "elasticsearch") {
+        return "Elasticsearch";
+    }
+
+    return nullptr;
+}
+
+// Returns whether the output of a format is a database given by its connection settings, rather than a file
+static bool isDatabase(const string& format)
+{
+    return format == "postgis" || format == "elasticsearch";
+}
+
+static bool isPolygon(const OGRGeometry* geometry)
+{
+    auto type = wkbFlatten(geometry->getGeometryType());
+    return type == wkbPolygon || type == wkbMultiPolygon;
+}
+
+void ShardMerger::DatasetDeleter::operator()(GDALDataset* dataset) const
+{
+    GDALClose(dataset);
+}
+
+void ShardMerger::FeatureDeleter::operator()(OGRFeature* feature) const
+{
+    OGRFeature::DestroyFeature(feature);
+}
+
+ShardMerger::ShardMerger(OpenSpaceNetArgs&& args, bool suppressAll) :
+    args_(move(args)),
+    suppressAll_(suppressAll)
+{
+}
+
+void ShardMerger::process()
+{
+    GDALAllRegister();
+
+    readInputs();
+    removeDuplicates();
+    if(args_.nms) {
+        suppressSeams();
+    }
+    writeOutput();
+}
+
+size_t ShardMerger::featuresWritten() const
+{
+    return written_;
+}
+
+void ShardMerger::readInputs()
+{
+    for(size_t i = 0; i < args_.mergeInputs.size(); ++i) {
+        const auto& input = args_.mergeInputs[i];
+        OSN_LOG(info) << "Reading " << input << "...";
+
+        unique_ptr<GDALDataset, DatasetDeleter> dataset(
+            (GDALDataset*) GDALOpenEx(input.c_str(), GDAL_OF_VECTOR | GDAL_OF_READONLY, nullptr, nullptr, nullptr));
+        DG_CHECK(dataset, "Unable to open %s", input.c_str());
+
+        for(int l = 0; l < dataset->GetLayerCount(); ++l) {
+            auto layer = dataset->GetLayer(l);
+            auto categoryField = layer->GetLayerDefn()->GetFieldIndex("top_cat");
+            auto scoreField = layer->GetLayerDefn()->GetFieldIndex("top_score");
+
+            layer->ResetReading();
+            OGRFeature* feature;
+            while((feature = layer->GetNextFeature()) != nullptr) {
+                MergedFeature merged;
+                merged.feature.reset(feature);
+                merged.category = categoryField >= 0 ? feature->GetFieldAsString(categoryField) : "";
+                merged.score = scoreField >= 0 ? feature->GetFieldAsDouble(scoreField) : 0.0;
+                merged.input = i;
+                features_.push_back(move(merged));
+            }
+        }
+
+        inputs_.push_back(move(dataset));
+    }
+
+    removed_.assign(features_.size(), false);
+    OSN_LOG(info) << features_.size() << " features read from " << inputs_.size() << " inputs";
+}
+
+void ShardMerger::removeDuplicates()
+{
+    // A window that was processed by two shards yields identical features in both outputs
+    unordered_map<string, size_t> seen;
+    size_t count = 0;
+    for(size_t i = 0; i < features_.size(); ++i) {
+        const auto& merged = features_[i];
+
+        string key = merged.category;
+        key += '\0';
+        auto geometry = merged.feature->GetGeometryRef();
+        if(geometry) {
+            vector<unsigned char> wkb(geometry->WkbSize());
+            geometry->exportToWkb(wkbNDR, wkb.data());
+            key.append(wkb.begin(), wkb.end());
+        }
+
+        auto it = seen.emplace(move(key), merged.input).first;
+        if(it->second != merged.input) {
+            removed_[i] = true;
+            ++count;
+        }
+    }
+
+    OSN_LOG(info) << count << " duplicate features removed";
+}
+
+void ShardMerger::suppressSeams()
+{
+    // Features of the same category that come from different shards and overlap by more than the
+    // NMS threshold are the same object detected on both sides of a seam, only the best one is kept.
+    // Features are taken in the order of their scores, and a feature is removed if it overlaps a
+    // better one that was kept, as in the non-maximum suppression of the detection graph.
+    // Candidates are looked up in a grid of cells as large as the largest feature, so that every
+    // feature only has to be compared to the features in the cells it touches.
+    vector<size_t> order;
+    vector<OGREnvelope> envelopes(features_.size());
+    vector<double> areas(features_.size());
+    double cellSize = 0;
+    for(size_t i = 0; i < features_.size(); ++i) {
+        auto geometry = features_[i].feature->GetGeometryRef();
+        if(removed_[i] || !geometry || !isPolygon(geometry)) {
+            continue;
+        }
+
+        geometry->getEnvelope(&envelopes[i]);
+        areas[i] = OGR_G_Area((OGRGeometryH) geometry);
+        cellSize = std::max(cellSize, std::max(envelopes[i].MaxX - envelopes[i].MinX,
+                                               envelopes[i].MaxY - envelopes[i].MinY));
+        order.push_back(i);
+    }
+
+    if(order.empty() || cellSize <= 0) {
+        return;
+    }
+
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return features_[a].score > features_[b].score;
+    });
+
+    auto threshold = args_.overlap / 100;
+    map<pair<long, long>, vector<size_t>> grid;
+    size_t count = 0;
+    for(auto i : order) {
+        const auto& envelope = envelopes[i];
+        auto geometry = features_[i].feature->GetGeometryRef();
+
+        auto minX = (long) std::floor(envelope.MinX / cellSize);
+        auto maxX = (long) std::floor(envelope.MaxX / cellSize);
+        auto minY = (long) std::floor(envelope.MinY / cellSize);
+        auto maxY = (long) std::floor(envelope.MaxY / cellSize);
+
+        bool suppressed = false;
+        for(auto x = minX; x <= maxX && !suppressed; ++x) {
+            for(auto y = minY; y <= maxY && !suppressed; ++y) {
+                auto cell = grid.find({ x, y });
+                if(cell == grid.end()) {
+                    continue;
+                }
+
+                for(auto j : cell->second) {
+                    if((!suppressAll_ && features_[j].input == features_[i].input) ||
+                       features_[j].category != features_[i].category ||
+                       !envelopes[j].Intersects(envelope)) {
+                        continue;
+                    }
+
+                    unique_ptr<OGRGeometry> intersection(geometry->Intersection(features_[j].feature->GetGeometryRef()));
+                    if(!intersection) {
+                        continue;
+                    }
+
+                    auto intersectionArea = OGR_G_Area((OGRGeometryH) intersection.get());
+                    auto unionArea = areas[i] + areas[j] - intersectionArea;
+                    if(unionArea > 0 && intersectionArea / unionArea > threshold) {
+                        suppressed = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if(suppressed) {
+            removed_[i] = true;
+            ++count;
+        } else {
+            for(auto x = minX; x <= maxX; ++x) {
+                for(auto y = minY; y <= maxY; ++y) {
+                    grid[{ x, y }].push_back(i);
+                }
+            }
+        }
+    }
+
+    OSN_LOG(info) << count << " overlapping features removed" << (suppressAll_ ? "" : " along shard seams");
+}
+
+void ShardMerger::writeOutput()
+{
+    // The fields are taken from the input layer that has the most of them. Inputs without features
+    // may have no fields at all, e.g. an empty GeoJSON file.
+    OGRLayer* source = nullptr;
+    for(const auto& input : inputs_) {
+        for(int l = 0; l < input->GetLayerCount(); ++l) {
+            auto layer = input->GetLayer(l);
+            if(!source || layer->GetLayerDefn()->GetFieldCount() > source->GetLayerDefn()->GetFieldCount()) {
+                source = layer;
+            }
+        }
+    }
+    DG_CHECK(source, "No input layers to merge");
+
+    // Polygons are suppressed before they are converted to points, see OpenSpaceNet::mergePasses()
+    bool toPoints = args_.geometryType == deepcore::geometry::GeometryType::POINT;
+
+    auto name = driverName(args_.outputFormat);
+    DG_CHECK(name, "Output format %s is not supported by the merge action", args_.outputFormat.c_str());
+
+    auto driver = GetGDALDriverManager()->GetDriverByName(name);
+    DG_CHECK(driver, "GDAL driver %s is not available", name);
+
+    // A database is always opened, only its layer is replaced
+    unique_ptr<GDALDataset, DatasetDeleter> output;
+    if(args_.append || isDatabase(args_.outputFormat)) {
+        output.reset((GDALDataset*) GDALOpenEx(args_.outputPath.c_str(), GDAL_OF_VECTOR | GDAL_OF_UPDATE,
+                                               nullptr, nullptr, nullptr));
+    } else if(exists(args_.outputPath)) {
+        driver->Delete(args_.outputPath.c_str());
+    }
+
+    if(!output) {
+        char** options = nullptr;
+        if(args_.outputFormat == "sqlite") {
+            options = CSLSetNameValue(options, "SPATIALITE", "YES");
+        }
+        output.reset(driver->Create(args_.outputPath.c_str(), 0, 0, 0, GDT_Unknown, options));
+        CSLDestroy(options);
+    }
+    DG_CHECK(output, "Unable to create %s", args_.outputPath.c_str());
+
+    if(!args_.append) {
+        for(int l = 0; l < output->GetLayerCount(); ++l) {
+            if(args_.layerName == output->GetLayer(l)->GetName()) {
+                DG_CHECK(output->DeleteLayer(l) == OGRERR_NONE, "Unable to replace layer %s", args_.layerName.c_str());
+                break;
+            }
+        }
+    }
+
+    auto layer = output->GetLayerByName(args_.layerName.c_str());
+    if(!layer) {
+        char** options = nullptr;
+        if(args_.outputFormat == "csv") {
+            options = CSLSetNameValue(options, "GEOMETRY", "AS_WKT");
+        }
+
+        auto geometryType = toPoints ? wkbPoint : source->GetGeomType();
+        layer = output->CreateLayer(args_.layerName.c_str(), source->GetSpatialRef(), geometryType, options);
+        CSLDestroy(options);
+        DG_CHECK(layer, "Unable to create layer %s", args_.layerName.c_str());
+
+        auto definition = source->GetLayerDefn();
+        for(int i = 0; i < definition->GetFieldCount(); ++i) {
+            DG_CHECK(layer->CreateField(definition->GetFieldDefn(i)) == OGRERR_NONE,
+                     "Unable to create field %s", definition->GetFieldDefn(i)->GetNameRef());
+        }
+    }
+
+    size_t count = 0;
+    layer->StartTransaction();
+    OGRPoint centroid;
+    for(size_t i = 0; i < features_.size(); ++i) {
+        if(removed_[i]) {
+            continue;
+        }
+
+        unique_ptr<OGRFeature, FeatureDeleter> feature(OGRFeature::CreateFeature(layer->GetLayerDefn()));
+        feature->SetFrom(features_[i].feature.get(), TRUE);
+        auto geometry = feature->GetGeometryRef();
+        if(toPoints && geometry && isPolygon(geometry) && geometry->Centroid(&centroid) == OGRERR_NONE) {
+            feature->SetGeometry(&centroid);
+        }
+        DG_CHECK(layer->CreateFeature(feature.get()) == OGRERR_NONE, "Unable to write a feature to %s",
+                 args_.outputPath.c_str());
+        ++count;
+    }
+    layer->CommitTransaction();
+
+    written_ = count;
+    OSN_LOG(info) << count << " features written to " << args_.outputPath;
+}
+
+} } // namespace dg { namespace osn {
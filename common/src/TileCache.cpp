@@ -0,0 +1,408 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "TileCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cmath>
+#include <cpl_http.h>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <json/json.h>
+#include <memory>
+#include <mutex>
+#include <ogr_spatialref.h>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <utility/Logging.h>
+
+namespace dg { namespace osn {
+
+using boost::filesystem::path;
+using boost::format;
+using boost::lexical_cast;
+using boost::replace_all;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+// Spherical mercator extent of the tile matrices
+static const double WEB_MERCATOR_EXTENT = 20037508.342789244;
+
+// Side of the map service tiles, in pixels
+static const int TILE_SIZE = 256;
+
+// Seconds after which a cached tile is downloaded again
+static const int TILE_EXPIRY_SECONDS = 7 * 24 * 60 * 60;
+
+// Number of times a tile is requested before the download fails
+static const int TILE_ATTEMPTS = 3;
+
+static string escapeXml(string value)
+{
+    replace_all(value, "&", "&amp;");
+    replace_all(value, "<", "&lt;");
+    replace_all(value, ">", "&gt;");
+    replace_all(value, "\"", "&quot;");
+    return value;
+}
+
+// Returns a directory name for a part of a URL, with everything but letters and digits replaced
+static string toDirName(const string& value)
+{
+    string name;
+    for(char c : value) {
+        name += std::isalnum((unsigned char) c) ? c : '_';
+    }
+    return name;
+}
+
+static string wmtsTileUrl(const string& host, const string& token)
+{
+    return (format("https://%1%/earthservice/wmtsaccess?connectId=%2%&SERVICE=WMTS&REQUEST=GetTile&VERSION=1.0.0"
+                   "&LAYER=DigitalGlobe:ImageryTileService&STYLE=&FORMAT=image/jpeg&TILEMATRIXSET=EPSG:3857"
+                   "&TILEMATRIX=EPSG:3857:{z}&TILEROW={y}&TILECOL={x}") % host % token).str();
+}
+
+// Returns the column of the web mercator tile that contains a longitude
+static int tileX(double lon, int zoom)
+{
+    auto tiles = 1 << zoom;
+    return std::min(std::max((int) std::floor((lon + 180.0) / 360.0 * tiles), 0), tiles - 1);
+}
+
+// Returns the row of the web mercator tile that contains a latitude
+static int tileY(double lat, int zoom)
+{
+    auto tiles = 1 << zoom;
+    auto latRadians = lat * M_PI / 180.0;
+    auto mercatorY = std::log(std::tan(latRadians) + 1 / std::cos(latRadians)) / M_PI;
+    return std::min(std::max((int) std::floor((1 - mercatorY) / 2 * tiles), 0), tiles - 1);
+}
+
+// Fetches a URL, returns false if it does not exist and throws if it can not be fetched
+static bool fetch(const string& url, const string& credentials, string& data)
+{
+    char** options = nullptr;
+    if(!credentials.empty()) {
+        options = CSLSetNameValue(options, "USERPWD", credentials.c_str());
+    }
+
+    unique_ptr<CPLHTTPResult, void (*)(CPLHTTPResult*)> result(CPLHTTPFetch(url.c_str(), options),
+                                                                CPLHTTPDestroyResult);
+    CSLDestroy(options);
+    DG_CHECK(result, "Unable to fetch %s", url.c_str());
+
+    // Services answer tiles without data with 204 or 404
+    string error = result->pszErrBuf ? result->pszErrBuf : "";
+    if(error.find("HTTP error code : 404") != string::npos) {
+        return false;
+    }
+    DG_CHECK(!result->nStatus && error.empty(), "Unable to fetch %s: %s", url.c_str(), error.c_str());
+
+    data.assign((const char*) result->pabyData, result->pabyData ? result->nDataLen : 0);
+    return !data.empty();
+}
+
+TileCache::TileCache(const OpenSpaceNetArgs& args) :
+    args_(args)
+{
+}
+
+string TileCache::datasetDescription() const
+{
+    DG_CHECK(args_.bbox, "A bounding box is required for the tile cache");
+
+    // The tiles of the zoom level that cover the bounding box, rows count from the north
+    const auto& bbox = *args_.bbox;
+    int left = tileX(bbox.x, args_.zoom);
+    int right = tileX(bbox.x + bbox.width, args_.zoom);
+    int top = tileY(bbox.y + bbox.height, args_.zoom);
+    int bottom = tileY(bbox.y, args_.zoom);
+    cv::Rect tiles(left, top, right - left + 1, bottom - top + 1);
+
+    vector<cv::Point> allTiles;
+    vector<cv::Point> missingTiles;
+    auto now = std::time(nullptr);
+    for(int y = tiles.y; y < tiles.y + tiles.height; ++y) {
+        for(int x = tiles.x; x < tiles.x + tiles.width; ++x) {
+            cv::Point tile(x, y);
+            allTiles.push_back(tile);
+
+            auto tileFile = tilePath(tile);
+            if(!boost::filesystem::exists(tileFile) ||
+               now - boost::filesystem::last_write_time(tileFile) >= TILE_EXPIRY_SECONDS) {
+                missingTiles.push_back(tile);
+            }
+        }
+    }
+
+    OSN_LOG(info) << allTiles.size() - missingTiles.size() << " of " << allTiles.size()
+                  << " tiles are in the tile cache, downloading " << missingTiles.size() << " tiles...";
+    download(missingTiles);
+    trim(allTiles);
+
+    return virtualDataset(tiles);
+}
+
+string TileCache::tileUrl() const
+{
+    switch(args_.source) {
+        case Source::DGCS:
+            return wmtsTileUrl(DGCS_HOST, args_.token);
+
+        case Source::EVWHS:
+            return wmtsTileUrl(EVWHS_HOST, args_.token);
+
+        case Source::MAPS_API:
+            return (format("https://api.mapbox.com/v4/%1%/{z}/{x}/{y}.jpg?access_token=%2%") % args_.mapId
+                    % args_.token).str();
+
+        case Source::TILE_JSON:
+            return tileJsonUrl();
+
+        default:
+            DG_ERROR_THROW("Tile cache is not supported for this source");
+    }
+}
+
+string TileCache::tileJsonUrl() const
+{
+    // The URL may name the metadata itself, or the tile directory next to it, see --url
+    string data;
+    bool found = false;
+    for(const auto& url : { args_.url, args_.url + ".json" }) {
+        try {
+            found = fetch(url, args_.credentials, data);
+        } catch(const std::exception&) {
+            found = false;
+        }
+
+        if(found) {
+            break;
+        }
+    }
+    DG_CHECK(found, "Unable to read the TileJSON metadata from %s", args_.url.c_str());
+
+    Json::CharReaderBuilder builder;
+    unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    Json::Value tileJson;
+    string errors;
+    DG_CHECK(reader->parse(data.data(), data.data() + data.size(), &tileJson, &errors),
+             "Unable to parse the TileJSON metadata: %s", errors.c_str());
+
+    const auto& tiles = tileJson["tiles"];
+    DG_CHECK(tiles.isArray() && tiles.size() && tiles[0].isString(), "TileJSON metadata does not list any tiles");
+    return tiles[0].asString();
+}
+
+string TileCache::serviceDir() const
+{
+    // The directory names the service and layer, but not the token or credentials
+    path dir(args_.tileCacheDir);
+    switch(args_.source) {
+        case Source::DGCS:
+            dir /= "dgcs";
+            break;
+
+        case Source::EVWHS:
+            dir /= "evwhs";
+            break;
+
+        case Source::MAPS_API:
+            dir = dir / "maps-api" / toDirName(args_.mapId);
+            break;
+
+        case Source::TILE_JSON:
+            dir = dir / "tile-json" / toDirName(args_.url.substr(0, args_.url.find('?')));
+            break;
+
+        default:
+            DG_ERROR_THROW("Tile cache is not supported for this source");
+    }
+
+    return (dir / lexical_cast<string>(args_.zoom)).string();
+}
+
+string TileCache::tilePath(const cv::Point& tile) const
+{
+    return (path(serviceDir()) / lexical_cast<string>(tile.x) / lexical_cast<string>(tile.y)).string();
+}
+
+void TileCache::download(const vector<cv::Point>& tiles) const
+{
+    if(tiles.empty()) {
+        return;
+    }
+
+    auto urlTemplate = tileUrl();
+    replace_all(urlTemplate, "{z}", lexical_cast<string>(args_.zoom));
+
+    // Every connection downloads the next missing tile when it finishes one. A tile is written to
+    // a temporary file first, so that an interrupted download never leaves a partial tile.
+    std::atomic<size_t> nextTile(0);
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    vector<std::thread> threads;
+    auto connections = std::min((size_t) std::max(args_.maxConnections, 1), tiles.size());
+    for(size_t connection = 0; connection < connections; ++connection) {
+        threads.emplace_back([&] {
+            for(auto i = nextTile++; i < tiles.size(); i = nextTile++) {
+                try {
+                    auto url = urlTemplate;
+                    replace_all(url, "{x}", lexical_cast<string>(tiles[i].x));
+                    replace_all(url, "{y}", lexical_cast<string>(tiles[i].y));
+
+                    // A tile without data is cached as an empty file, so that it is not requested again
+                    string data;
+                    for(int attempt = 1; ; ++attempt) {
+                        try {
+                            fetch(url, args_.credentials, data);
+                            break;
+                        } catch(const std::exception&) {
+                            if(attempt == TILE_ATTEMPTS) {
+                                throw;
+                            }
+                        }
+                    }
+
+                    auto tileFile = tilePath(tiles[i]);
+                    auto partFile = tileFile + ".part";
+                    boost::filesystem::create_directories(path(tileFile).parent_path());
+                    {
+                        std::ofstream file(partFile, std::ios::binary);
+                        file.write(data.data(), data.size());
+                        DG_CHECK(file, "Unable to write %s", partFile.c_str());
+                    }
+                    boost::filesystem::rename(partFile, tileFile);
+                } catch(...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if(!error) {
+                        error = std::current_exception();
+                    }
+                    nextTile = tiles.size();
+                }
+            }
+        });
+    }
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void TileCache::trim(const vector<cv::Point>& keep) const
+{
+    if(!args_.tileCacheSize) {
+        return;
+    }
+
+    std::set<string> keepFiles;
+    for(const auto& tile : keep) {
+        keepFiles.insert(path(tilePath(tile)).string());
+    }
+
+    // The tiles that were downloaded first are removed, except for the tiles of this run
+    vector<std::tuple<std::time_t, uintmax_t, string>> files;
+    uintmax_t total = 0;
+    for(boost::filesystem::recursive_directory_iterator it(args_.tileCacheDir), end; it != end; ++it) {
+        if(boost::filesystem::is_regular_file(it->path())) {
+            auto size = boost::filesystem::file_size(it->path());
+            files.emplace_back(boost::filesystem::last_write_time(it->path()), size, it->path().string());
+            total += size;
+        }
+    }
+
+    if(total <= args_.tileCacheSize) {
+        return;
+    }
+
+    std::sort(files.begin(), files.end());
+    size_t removed = 0;
+    for(const auto& file : files) {
+        if(total <= args_.tileCacheSize) {
+            break;
+        }
+
+        if(!keepFiles.count(std::get<2>(file))) {
+            boost::filesystem::remove(std::get<2>(file));
+            total -= std::get<1>(file);
+            ++removed;
+        }
+    }
+
+    OSN_LOG(info) << removed << " tiles removed from the tile cache";
+}
+
+string TileCache::virtualDataset(const cv::Rect& tiles) const
+{
+    OGRSpatialReference sr;
+    sr.importFromEPSG(3857);
+    char* wkt = nullptr;
+    sr.exportToWkt(&wkt);
+    string srWkt = wkt ? wkt : "";
+    CPLFree(wkt);
+
+    auto resolution = 2 * WEB_MERCATOR_EXTENT / ((double) TILE_SIZE * (1 << args_.zoom));
+    std::ostringstream description;
+    description.precision(17);
+    description << "<VRTDataset rasterXSize=\"" << tiles.width * TILE_SIZE
+                << "\" rasterYSize=\"" << tiles.height * TILE_SIZE << "\">"
+                << "<SRS>" << escapeXml(srWkt) << "</SRS>"
+                << "<GeoTransform>" << -WEB_MERCATOR_EXTENT + tiles.x * TILE_SIZE * resolution << "," << resolution
+                << ",0," << WEB_MERCATOR_EXTENT - tiles.y * TILE_SIZE * resolution << ",0," << -resolution
+                << "</GeoTransform>";
+
+    // Tiles without data are left out, and read as zeros
+    const char* colors[] = { "Red", "Green", "Blue" };
+    for(int band = 1; band <= 3; ++band) {
+        description << "<VRTRasterBand dataType=\"Byte\" band=\"" << band << "\" blockXSize=\"" << TILE_SIZE
+                    << "\" blockYSize=\"" << TILE_SIZE << "\">"
+                    << "<ColorInterp>" << colors[band - 1] << "</ColorInterp>";
+        for(int y = tiles.y; y < tiles.y + tiles.height; ++y) {
+            for(int x = tiles.x; x < tiles.x + tiles.width; ++x) {
+                auto tileFile = tilePath(cv::Point(x, y));
+                if(!boost::filesystem::file_size(tileFile)) {
+                    continue;
+                }
+
+                description << "<SimpleSource><SourceFilename relativeToVRT=\"0\">" << escapeXml(tileFile)
+                            << "</SourceFilename><SourceBand>" << band << "</SourceBand>"
+                            << "<SrcRect xOff=\"0\" yOff=\"0\" xSize=\"" << TILE_SIZE << "\" ySize=\"" << TILE_SIZE << "\"/>"
+                            << "<DstRect xOff=\"" << (x - tiles.x) * TILE_SIZE << "\" yOff=\"" << (y - tiles.y) * TILE_SIZE
+                            << "\" xSize=\"" << TILE_SIZE << "\" ySize=\"" << TILE_SIZE << "\"/></SimpleSource>";
+            }
+        }
+        description << "</VRTRasterBand>";
+    }
+    description << "</VRTDataset>";
+
+    return description.str();
+}
+
+} } // namespace dg { namespace osn {
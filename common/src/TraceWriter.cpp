@@ -0,0 +1,150 @@
+/********************************************************************************
+* Copyright 2017 DigitalGlobe, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+********************************************************************************/
+
+#include "TraceWriter.h"
+
+#include <json/json.h>
+#include <OpenSpaceNetArgs.h>
+#include <utility/Logging.h>
+
+namespace dg { namespace osn {
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+using std::string;
+
+// All events belong to this process
+static const int TRACE_PID = 1;
+
+// Writes an event as a single line of JSON
+static string formatEvent(const Json::Value& event)
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, event);
+}
+
+TraceWriter::TraceWriter(const string& path) :
+    startTime_(steady_clock::now()),
+    file_(path)
+{
+    DG_CHECK(file_, "Unable to open %s", path.c_str());
+    file_ << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+}
+
+TraceWriter::~TraceWriter()
+{
+    file_ << "\n]}\n";
+    if(!file_) {
+        OSN_LOG(warning) << "Unable to write the trace";
+    }
+}
+
+void TraceWriter::complete(const string& name, const string& category, TimePoint startTime)
+{
+    auto endTime = steady_clock::now();
+
+    Json::Value event;
+    event["name"] = name;
+    event["cat"] = category;
+    event["ph"] = "X";
+    event["pid"] = TRACE_PID;
+    event["ts"] = (Json::Int64) micros(startTime);
+    event["dur"] = (Json::Int64) duration_cast<microseconds>(endTime - startTime).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    event["tid"] = threadId(name);
+    writeEvent(formatEvent(event));
+}
+
+void TraceWriter::instant(const string& name, const string& category, int64_t count)
+{
+    Json::Value event;
+    event["name"] = name;
+    event["cat"] = category;
+    event["ph"] = "i";
+    event["s"] = "t";
+    event["pid"] = TRACE_PID;
+    event["ts"] = (Json::Int64) micros(steady_clock::now());
+    event["args"]["count"] = (Json::Int64) count;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    event["tid"] = threadId(name);
+    writeEvent(formatEvent(event));
+}
+
+void TraceWriter::counter(const string& name, const string& series, double value)
+{
+    Json::Value event;
+    event["name"] = name;
+    event["ph"] = "C";
+    event["pid"] = TRACE_PID;
+    event["ts"] = (Json::Int64) micros(steady_clock::now());
+    event["args"][series.empty() ? name : series] = value;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    writeEvent(formatEvent(event));
+}
+
+int TraceWriter::threadId(const string& name)
+{
+    auto inserted = threadIds_.emplace(std::this_thread::get_id(), (int) threadIds_.size() + 1);
+    if(inserted.second) {
+        Json::Value event;
+        event["name"] = "thread_name";
+        event["ph"] = "M";
+        event["pid"] = TRACE_PID;
+        event["tid"] = inserted.first->second;
+        event["args"]["name"] = name;
+        writeEvent(formatEvent(event));
+    }
+
+    return inserted.first->second;
+}
+
+int64_t TraceWriter::micros(TimePoint time) const
+{
+    return duration_cast<microseconds>(time - startTime_).count();
+}
+
+void TraceWriter::writeEvent(const string& event)
+{
+    if(!first_) {
+        file_ << ",\n";
+    }
+    file_ << event;
+    first_ = false;
+}
+
+TraceSpan::TraceSpan(TraceWriter* writer, string name, string category) :
+    writer_(writer),
+    name_(std::move(name)),
+    category_(std::move(category))
+{
+    if(writer_) {
+        startTime_ = steady_clock::now();
+    }
+}
+
+TraceSpan::~TraceSpan()
+{
+    if(writer_) {
+        writer_->complete(name_, category_, startTime_);
+    }
+}
+
+} } // namespace dg { namespace osn {